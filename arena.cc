@@ -0,0 +1,93 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include <v8.h>
+#include "./arena.h"
+
+node_db::Arena::Arena(size_t chunkSize)
+    :chunkSize(chunkSize),
+    allocated(0),
+    reported(0),
+    chunks(NULL),
+    references(1) {
+}
+
+node_db::Arena::~Arena() {
+    if (this->reported > 0) {
+        v8::V8::AdjustAmountOfExternalAllocatedMemory(-static_cast<intptr_t>(this->reported));
+    }
+
+    while (this->chunks != NULL) {
+        chunk_t* next = this->chunks->next;
+        free(this->chunks);
+        this->chunks = next;
+    }
+}
+
+void node_db::Arena::retain() throw() {
+    this->references++;
+}
+
+void node_db::Arena::share() throw() {
+    // Memory viewed from JS is reported to V8 once, so the GC knows what the
+    // views keep alive
+    if (this->reported == 0 && this->allocated > 0) {
+        this->reported = this->allocated;
+        v8::V8::AdjustAmountOfExternalAllocatedMemory(static_cast<intptr_t>(this->reported));
+    }
+    this->retain();
+}
+
+void node_db::Arena::release() throw() {
+    // Only called from the main thread: by the query once it is done with the
+    // rows, and by the free callback of every Buffer wrapping arena memory
+    if (--this->references == 0) {
+        delete this;
+    }
+}
+
+node_db::Arena::chunk_t* node_db::Arena::addChunk(size_t capacity) throw(node_db::Exception&) {
+    chunk_t* chunk = static_cast<chunk_t*>(malloc(sizeof(chunk_t) + capacity));
+    if (chunk == NULL) {
+        throw node_db::Exception("Could not allocate memory for rows");
+    }
+
+    chunk->capacity = capacity;
+    chunk->used = 0;
+    this->allocated += capacity;
+
+    // Oversized allocations get a dedicated chunk kept behind the current one, so
+    // the remaining space of the current chunk is still used by later allocations
+    if (this->chunks != NULL && capacity > this->chunkSize) {
+        chunk->next = this->chunks->next;
+        this->chunks->next = chunk;
+    } else {
+        chunk->next = this->chunks;
+        this->chunks = chunk;
+    }
+
+    return chunk;
+}
+
+void* node_db::Arena::allocate(size_t size) throw(node_db::Exception&) {
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    chunk_t* chunk = this->chunks;
+    if (chunk == NULL || chunk->capacity - chunk->used < size) {
+        chunk = this->addChunk(size > this->chunkSize ? size : this->chunkSize);
+    }
+
+    char* data = reinterpret_cast<char*>(chunk + 1) + chunk->used;
+    chunk->used += size;
+
+    return data;
+}
+
+char* node_db::Arena::copy(const char* data, size_t length) throw(node_db::Exception&) {
+    char* copied = static_cast<char*>(this->allocate(length + 1));
+    memcpy(copied, data, length);
+    copied[length] = '\0';
+    return copied;
+}
+
+size_t node_db::Arena::size() const throw() {
+    return this->allocated;
+}
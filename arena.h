@@ -0,0 +1,39 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <cstring>
+#include "./exception.h"
+
+namespace node_db {
+class Arena {
+    public:
+        explicit Arena(size_t chunkSize = 64 * 1024);
+        void retain() throw();
+        void share() throw();
+        void release() throw();
+        void* allocate(size_t size) throw(Exception&);
+        char* copy(const char* data, size_t length) throw(Exception&);
+        size_t size() const throw();
+
+    protected:
+        struct chunk_t {
+            chunk_t* next;
+            size_t capacity;
+            size_t used;
+        };
+        static const size_t alignment = 8;
+        size_t chunkSize;
+        size_t allocated;
+        size_t reported;
+        chunk_t* chunks;
+        unsigned int references;
+
+        ~Arena();
+        chunk_t* addChunk(size_t capacity) throw(Exception&);
+};
+}
+
+#endif  // ARENA_H_
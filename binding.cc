@@ -1,7 +1,7 @@
 // Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
 #include "./binding.h"
 
-node_db::Binding::Binding(): node_db::EventEmitter(), connection(NULL), cbConnect(NULL) {
+node_db::Binding::Binding(): node_db::EventEmitter(), connection(NULL), cbConnect(NULL), maxRows(0), maxResultBytes(0) {
 }
 
 node_db::Binding::~Binding() {
@@ -13,6 +13,8 @@ node_db::Binding::~Binding() {
 uv_async_t node_db::Binding::g_async;
 
 void node_db::Binding::Init(v8::Handle<v8::Object> target, v8::Persistent<v8::FunctionTemplate> constructorTemplate) {
+    node_db::EventEmitter::Init();
+
     NODE_ADD_CONSTANT(constructorTemplate, COLUMN_TYPE_STRING, node_db::Result::Column::STRING);
     NODE_ADD_CONSTANT(constructorTemplate, COLUMN_TYPE_BOOL, node_db::Result::Column::BOOL);
     NODE_ADD_CONSTANT(constructorTemplate, COLUMN_TYPE_INT, node_db::Result::Column::INT);
@@ -64,10 +66,20 @@ v8::Handle<v8::Value> node_db::Binding::Connect(const v8::Arguments& args) {
             }
 
             ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, async);
+            ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, maxRows);
+            ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, maxResultBytes);
 
             if (options->Has(async_key) && options->Get(async_key)->IsFalse()) {
                 async = false;
             }
+
+            if (options->Has(maxRows_key)) {
+                binding->maxRows = options->Get(maxRows_key)->Uint32Value();
+            }
+
+            if (options->Has(maxResultBytes_key)) {
+                binding->maxResultBytes = options->Get(maxResultBytes_key)->Uint32Value();
+            }
         }
 
         if (callbackIndex >= 0) {
@@ -127,11 +139,11 @@ void node_db::Binding::connectFinished(connect_request_t* request) {
         argv[0] = v8::Local<v8::Value>::New(v8::Null());
         argv[1] = server;
 
-        request->binding->Emit("ready", 1, &argv[1]);
+        request->binding->Emit(syReady, 1, &argv[1]);
     } else {
         argv[0] = v8::String::New(request->error != NULL ? request->error : "(unknown error)");
 
-        request->binding->Emit("error", 1, argv);
+        request->binding->Emit(syError, 1, argv);
     }
 
     if (request->binding->cbConnect != NULL && !request->binding->cbConnect->IsEmpty()) {
@@ -246,6 +258,7 @@ v8::Handle<v8::Value> node_db::Binding::Query(const v8::Arguments& args) {
 
     node_db::Query* queryInstance = node::ObjectWrap::Unwrap<node_db::Query>(query);
     queryInstance->setConnection(binding->connection);
+    queryInstance->setLimits(binding->maxRows, binding->maxResultBytes);
 
     v8::Handle<v8::Value> set = queryInstance->set(args);
     if (!set.IsEmpty()) {
@@ -25,6 +25,8 @@ class Binding : public EventEmitter {
             const char* error;
         };
         v8::Persistent<v8::Function>* cbConnect;
+        uint32_t maxRows;
+        uint32_t maxResultBytes;
 
         Binding();
         ~Binding();
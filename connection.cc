@@ -4,11 +4,17 @@
 node_db::Connection::Connection()
     :quoteString('\''),
     alive(false),
+    busy(false),
     quoteName('`') {
     pthread_mutex_init(&(this->connectionLock), NULL);
+    pthread_mutex_init(&(this->releasedLock), NULL);
 }
 
 node_db::Connection::~Connection() {
+    // Statements must be released by the driver, which is already destroyed
+    assert(this->statements.empty());
+    assert(this->released.empty());
+    pthread_mutex_destroy(&(this->releasedLock));
     pthread_mutex_destroy(&(this->connectionLock));
 }
 
@@ -56,6 +62,21 @@ bool node_db::Connection::isAlive(bool ping) {
     return this->alive;
 }
 
+bool node_db::Connection::isBusy() const {
+    // Only read and written with the connection locked
+    return this->busy;
+}
+
+void node_db::Connection::setBusy(bool busy) {
+    this->busy = busy;
+}
+
+void node_db::Connection::appendEscaped(std::string* output, const std::string& string) const throw(Exception&) {
+    // This still allocates the escaped copy, drivers able to escape into the
+    // output directly should override it
+    output->append(this->escape(string));
+}
+
 std::string node_db::Connection::escapeName(const std::string& string) const throw(Exception&) {
     std::string escaped;
     if (string.find_first_of('.') != string.npos) {
@@ -92,3 +113,81 @@ void node_db::Connection::lock() {
 void node_db::Connection::unlock() {
     pthread_mutex_unlock(&(this->connectionLock));
 }
+
+node_db::Statement* node_db::Connection::prepare(const std::string& query) const throw(Exception&) {
+    throw node_db::Exception("Not implemented");
+}
+
+node_db::Statement* node_db::Connection::statement(const std::string& query) throw(Exception&) {
+    // Called with the connection locked, most recently used statements first
+    this->destroyStatements();
+
+    std::map<std::string, statement_t>::iterator found = this->statements.find(query);
+    if (found != this->statements.end()) {
+        this->statementsUsage.splice(this->statementsUsage.begin(), this->statementsUsage, found->second.usage);
+        if (!found->second.statement->isBusy()) {
+            return found->second.statement;
+        }
+
+        // Executing it again would clobber the result still being read, so
+        // the busy statement is replaced and lives on until that result goes
+        Statement* prepared = this->prepare(query);
+        if (prepared == NULL) {
+            throw node_db::Exception("Could not prepare statement");
+        }
+        prepared->connection = this;
+        found->second.statement->release();
+        found->second.statement = prepared;
+        return prepared;
+    }
+
+    statement_t prepared;
+    prepared.statement = this->prepare(query);
+    if (prepared.statement == NULL) {
+        throw node_db::Exception("Could not prepare statement");
+    }
+    prepared.statement->connection = this;
+
+    found = this->statements.insert(std::make_pair(query, prepared)).first;
+    this->statementsUsage.push_front(&(found->first));
+    found->second.usage = this->statementsUsage.begin();
+
+    if (this->statements.size() > Connection::statementCacheSize) {
+        std::map<std::string, statement_t>::iterator oldest = this->statements.find(*(this->statementsUsage.back()));
+        this->statementsUsage.pop_back();
+        oldest->second.statement->release();
+        this->statements.erase(oldest);
+    }
+
+    return found->second.statement;
+}
+
+void node_db::Connection::clearStatements() {
+    // Drivers call this from close(), with the connection locked and while
+    // statement handles are still valid
+    for (std::map<std::string, statement_t>::iterator iterator = this->statements.begin(), end = this->statements.end(); iterator != end; ++iterator) {
+        iterator->second.statement->release();
+    }
+    this->statements.clear();
+    this->statementsUsage.clear();
+    this->destroyStatements();
+}
+
+void node_db::Connection::releaseStatement(Statement* statement) {
+    // Unused statements are queued, as the last reference may be dropped on
+    // the main thread while a query runs on the connection
+    pthread_mutex_lock(&(this->releasedLock));
+    this->released.push_back(statement);
+    pthread_mutex_unlock(&(this->releasedLock));
+}
+
+void node_db::Connection::destroyStatements() {
+    std::vector<Statement*> released;
+    pthread_mutex_lock(&(this->releasedLock));
+    released.swap(this->released);
+    pthread_mutex_unlock(&(this->releasedLock));
+
+    for (std::vector<Statement*>::iterator iterator = released.begin(), end = released.end(); iterator != end; ++iterator) {
+        delete *iterator;
+    }
+}
@@ -2,12 +2,17 @@
 #ifndef CONNECTION_H_
 #define CONNECTION_H_
 
+#include <assert.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <cstring>
+#include <list>
+#include <map>
 #include <string>
+#include <vector>
 #include "./exception.h"
 #include "./result.h"
+#include "./statement.h"
 
 namespace node_db {
 class Connection {
@@ -27,24 +32,45 @@ class Connection {
         virtual uint32_t getPort() const;
         virtual void setPort(uint32_t port);
         virtual bool isAlive(bool ping = false);
+        bool isBusy() const;
+        void setBusy(bool busy);
         virtual std::string escapeName(const std::string& string) const throw(Exception&);
         virtual void open() throw(Exception&) = 0;
         virtual void close() = 0;
         virtual std::string escape(const std::string& string) const throw(Exception&) = 0;
+        virtual void appendEscaped(std::string* output, const std::string& string) const throw(Exception&);
         virtual std::string version() const = 0;
         virtual Result* query(const std::string& query) const throw(Exception&) = 0;
+        virtual Statement* prepare(const std::string& query) const throw(Exception&);
+        Statement* statement(const std::string& query) throw(Exception&);
         virtual void lock();
         virtual void unlock();
 
     protected:
+        struct statement_t {
+            Statement* statement;
+            std::list<const std::string*>::iterator usage;
+        };
+        static const size_t statementCacheSize = 64;
         std::string hostname;
         std::string user;
         std::string password;
         std::string database;
         uint32_t port;
         bool alive;
+        bool busy;
         char quoteName;
         pthread_mutex_t connectionLock;
+        std::map<std::string, statement_t> statements;
+        std::list<const std::string*> statementsUsage;
+        pthread_mutex_t releasedLock;
+        std::vector<Statement*> released;
+
+        void clearStatements();
+        void releaseStatement(Statement* statement);
+        void destroyStatements();
+
+        friend class Statement;
 };
 }
 
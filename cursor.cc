@@ -0,0 +1,237 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./cursor.h"
+
+v8::Persistent<v8::FunctionTemplate> node_db::Cursor::constructorTemplate;
+
+void node_db::Cursor::Init() {
+    v8::HandleScope scope;
+
+    v8::Local<v8::FunctionTemplate> t = v8::FunctionTemplate::New(New);
+
+    constructorTemplate = v8::Persistent<v8::FunctionTemplate>::New(t);
+    constructorTemplate->InstanceTemplate()->SetInternalFieldCount(1);
+    constructorTemplate->SetClassName(v8::String::NewSymbol("Cursor"));
+
+    NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "fetch", Fetch);
+    NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "close", Close);
+}
+
+node_db::Cursor::Cursor(): node::ObjectWrap(),
+    request(NULL), busy(false), reading(false) {
+}
+
+node_db::Cursor::~Cursor() {
+    this->close();
+}
+
+v8::Local<v8::Object> node_db::Cursor::create(Query::execute_request_t* request) {
+    v8::Local<v8::Object> object = constructorTemplate->GetFunction()->NewInstance();
+
+    // The cursor takes over the request, and keeps its query alive until closed
+    node_db::Cursor* cursor = node::ObjectWrap::Unwrap<node_db::Cursor>(object);
+    cursor->request = request;
+    cursor->reading = !request->buffered;
+    request->query->Ref();
+
+    return object;
+}
+
+v8::Handle<v8::Value> node_db::Cursor::New(const v8::Arguments& args) {
+    v8::HandleScope scope;
+
+    node_db::Cursor* cursor = new node_db::Cursor();
+    if (cursor == NULL) {
+        THROW_EXCEPTION("Can't create cursor object")
+    }
+
+    cursor->Wrap(args.This());
+
+    return scope.Close(args.This());
+}
+
+v8::Handle<v8::Value> node_db::Cursor::Fetch(const v8::Arguments& args) {
+    v8::HandleScope scope;
+
+    ARG_CHECK_UINT32(0, count);
+    ARG_CHECK_FUNCTION(1, callback);
+
+    node_db::Cursor* cursor = node::ObjectWrap::Unwrap<node_db::Cursor>(args.This());
+    assert(cursor);
+
+    uint32_t count = args[0]->Uint32Value();
+    if (count == 0) {
+        THROW_EXCEPTION("Argument \"count\" must be greater than 0")
+    }
+
+    if (cursor->request == NULL) {
+        THROW_EXCEPTION("Can't fetch rows from a closed cursor")
+    }
+
+    if (cursor->busy) {
+        THROW_EXCEPTION("Cursor is already fetching rows")
+    }
+
+    fetch_request_t* request = new fetch_request_t();
+    if (request == NULL) {
+        THROW_EXCEPTION("Could not create EIO request")
+    }
+
+    request->cursor = cursor;
+    request->count = count;
+    request->done = false;
+    request->error = NULL;
+    request->cbFetch = node::cb_persist(args[1]);
+
+    cursor->busy = true;
+    cursor->Ref();
+
+    uv_work_t* req = new uv_work_t();
+    req->data = request;
+    uv_queue_work(uv_default_loop(), req, uvFetch, (uv_after_work_cb)uvFetchFinished);
+
+#if NODE_VERSION_AT_LEAST(0, 7, 9)
+    uv_ref((uv_handle_t *)&Query::g_async);
+#else
+    uv_ref(uv_default_loop());
+#endif
+
+    return scope.Close(v8::Undefined());
+}
+
+v8::Handle<v8::Value> node_db::Cursor::Close(const v8::Arguments& args) {
+    v8::HandleScope scope;
+
+    node_db::Cursor* cursor = node::ObjectWrap::Unwrap<node_db::Cursor>(args.This());
+    assert(cursor);
+
+    if (cursor->busy) {
+        THROW_EXCEPTION("Can't close a cursor while it is fetching rows")
+    }
+
+    cursor->close();
+
+    return scope.Close(v8::Undefined());
+}
+
+void node_db::Cursor::uvFetch(uv_work_t* uvRequest) {
+    fetch_request_t* request = static_cast<fetch_request_t*>(uvRequest->data);
+    assert(request);
+
+    Query::execute_request_t* execute = request->cursor->request;
+    node_db::Connection* connection = execute->query->connection;
+
+    bool locked = false;
+    try {
+        execute->arena = new node_db::Arena();
+        execute->rows = new std::vector<Query::row_t*>();
+        if (execute->arena == NULL || execute->rows == NULL) {
+            throw node_db::Exception("Could not create buffer for rows");
+        }
+
+        if (execute->result != NULL) {
+            connection->lock();
+            locked = true;
+            while (execute->rows->size() < request->count && execute->result->hasNext()) {
+                execute->rows->push_back(Query::copyRow(execute, execute->arena));
+            }
+            connection->unlock();
+            locked = false;
+        }
+        request->done = (execute->result == NULL || !execute->result->hasNext());
+    } catch(const node_db::Exception& exception) {
+        if (locked) {
+            connection->unlock();
+        }
+        request->error = new std::string(exception.what());
+    }
+}
+
+void node_db::Cursor::uvFetchFinished(uv_work_t* uvRequest, int status) {
+    v8::HandleScope scope;
+
+    fetch_request_t* request = static_cast<fetch_request_t*>(uvRequest->data);
+    assert(request);
+
+    node_db::Cursor* cursor = request->cursor;
+    Query::execute_request_t* execute = cursor->request;
+    cursor->busy = false;
+
+    v8::Local<v8::Value> argv[3];
+    int argc;
+    if (request->error == NULL) {
+        argv[0] = v8::Local<v8::Value>::New(v8::Null());
+        if (execute->query->columnar) {
+            argv[1] = execute->query->columnarRows(execute, *(execute->rows));
+        } else {
+            argv[1] = execute->query->emitRows(execute, *(execute->rows), request->done);
+            if (argv[1].IsEmpty()) {
+                argv[1] = v8::Local<v8::Value>::New(v8::Null());
+            }
+        }
+        argv[2] = v8::Local<v8::Value>::New(request->done ? v8::True() : v8::False());
+        argc = 3;
+    } else {
+        argv[0] = v8::String::New(request->error->c_str());
+        argc = 1;
+        delete request->error;
+    }
+
+    Query::freeRows(execute->rows, execute->arena);
+    execute->rows = NULL;
+    execute->arena = NULL;
+
+    // An exhausted result is released right away, there is nothing left to fetch
+    if (request->done && execute->result != NULL) {
+        delete execute->result;
+        execute->result = NULL;
+        cursor->releaseConnection(execute->query->connection);
+    }
+
+    if (!request->cbFetch->IsEmpty()) {
+        v8::TryCatch tryCatch;
+        (*(request->cbFetch))->Call(v8::Context::GetCurrent()->Global(), argc, argv);
+        if (tryCatch.HasCaught()) {
+            node::FatalException(tryCatch);
+        }
+    }
+
+#if NODE_VERSION_AT_LEAST(0, 7, 9)
+    uv_unref((uv_handle_t *)&Query::g_async);
+#else
+    uv_unref(uv_default_loop());
+#endif
+
+    cursor->Unref();
+
+    node::cb_destroy(request->cbFetch);
+    delete request;
+    delete uvRequest;
+}
+
+void node_db::Cursor::close() {
+    if (this->request == NULL) {
+        return;
+    }
+
+    // The result is freed first, as freeing an unbuffered result may still
+    // read from the connection
+    node_db::Query* query = this->request->query;
+    Query::freeRequest(this->request);
+    this->request = NULL;
+    this->releaseConnection(query->connection);
+
+    query->Unref();
+}
+
+void node_db::Cursor::releaseConnection(node_db::Connection* connection) {
+    if (!this->reading) {
+        return;
+    }
+
+    // The result was all that was reading from the connection, so other
+    // queries can use it again
+    connection->lock();
+    connection->setBusy(false);
+    connection->unlock();
+    this->reading = false;
+}
@@ -0,0 +1,45 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef CURSOR_H_
+#define CURSOR_H_
+
+#include <v8.h>
+#include <node.h>
+#include <node_object_wrap.h>
+#include <string>
+#include <vector>
+#include "./node_defs.h"
+#include "./exception.h"
+#include "./query.h"
+
+namespace node_db {
+class Cursor : public node::ObjectWrap {
+    public:
+        static void Init();
+        static v8::Local<v8::Object> create(Query::execute_request_t* request);
+
+    protected:
+        struct fetch_request_t {
+            Cursor* cursor;
+            uint32_t count;
+            bool done;
+            std::string* error;
+            v8::Persistent<v8::Function>* cbFetch;
+        };
+        static v8::Persistent<v8::FunctionTemplate> constructorTemplate;
+        Query::execute_request_t* request;
+        bool busy;
+        bool reading;
+
+        Cursor();
+        ~Cursor();
+        static v8::Handle<v8::Value> New(const v8::Arguments& args);
+        static v8::Handle<v8::Value> Fetch(const v8::Arguments& args);
+        static v8::Handle<v8::Value> Close(const v8::Arguments& args);
+        static void uvFetch(uv_work_t* uvRequest);
+        static void uvFetchFinished(uv_work_t* uvRequest, int status);
+        void close();
+        void releaseConnection(Connection* connection);
+};
+}
+
+#endif  // CURSOR_H_
@@ -1,38 +1,65 @@
 // Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
 #include "./events.h"
 
-#if !NODE_VERSION_AT_LEAST(0, 5, 0)
 v8::Persistent<v8::String> node_db::EventEmitter::syEmit;
-#endif
+v8::Persistent<v8::String> node_db::EventEmitter::syEvents;
+v8::Persistent<v8::String> node_db::EventEmitter::syBatch;
+v8::Persistent<v8::String> node_db::EventEmitter::syEach;
+v8::Persistent<v8::String> node_db::EventEmitter::syError;
+v8::Persistent<v8::String> node_db::EventEmitter::syReady;
+v8::Persistent<v8::String> node_db::EventEmitter::sySuccess;
 
 node_db::EventEmitter::EventEmitter() : node::ObjectWrap() {
 }
 
 void node_db::EventEmitter::Init() {
-#if !NODE_VERSION_AT_LEAST(0, 5, 0)
+    if (!syEmit.IsEmpty()) {
+        return;
+    }
+
     syEmit = NODE_PERSISTENT_SYMBOL("emit");
-#endif
+    syEvents = NODE_PERSISTENT_SYMBOL("_events");
+    syBatch = NODE_PERSISTENT_SYMBOL("batch");
+    syEach = NODE_PERSISTENT_SYMBOL("each");
+    syError = NODE_PERSISTENT_SYMBOL("error");
+    syReady = NODE_PERSISTENT_SYMBOL("ready");
+    sySuccess = NODE_PERSISTENT_SYMBOL("success");
 }
 
 bool node_db::EventEmitter::Emit(const char* event, int argc, v8::Handle<v8::Value> argv[]) {
     v8::HandleScope scope;
+    return this->Emit(v8::String::NewSymbol(event), argc, argv);
+}
+
+bool node_db::EventEmitter::Emit(v8::Handle<v8::String> event, int argc, v8::Handle<v8::Value> argv[]) {
+    v8::HandleScope scope;
 
+    // Every event emitted by the bindings fits in the stack buffer
     int nArgc = argc + 1;
-    v8::Handle<v8::Value>* nArgv = new v8::Handle<v8::Value>[nArgc];
-    if (nArgv == NULL) {
-        return false;
+    v8::Handle<v8::Value> stackArgv[maxStackArguments];
+    v8::Handle<v8::Value>* nArgv = stackArgv;
+    if (nArgc > maxStackArguments) {
+        nArgv = new v8::Handle<v8::Value>[nArgc];
+        if (nArgv == NULL) {
+            return false;
+        }
     }
 
-    nArgv[0] = v8::String::New(event);
+    nArgv[0] = event;
     for (int i=0; i < argc; i++) {
         nArgv[i + 1] = argv[i];
     }
 
-#if NODE_VERSION_AT_LEAST(0, 5, 0)
+#if NODE_VERSION_AT_LEAST(0, 8, 0)
+    node::MakeCallback(this->handle_, syEmit, nArgc, nArgv);
+#elif NODE_VERSION_AT_LEAST(0, 5, 0)
     node::MakeCallback(this->handle_, "emit", nArgc, nArgv);
 #else
     v8::Local<v8::Value> emit_v = this->handle_->Get(syEmit);
     if (!emit_v->IsFunction()) {
+        if (nArgv != stackArgv) {
+            delete [] nArgv;
+        }
         return false;
     }
     v8::Local<v8::Function> emit = v8::Local<v8::Function>::Cast(emit_v);
@@ -41,7 +68,9 @@ bool node_db::EventEmitter::Emit(const char* event, int argc, v8::Handle<v8::Val
     emit->Call(this->handle_, nArgc, nArgv);
 #endif
 
-    delete [] nArgv;
+    if (nArgv != stackArgv) {
+        delete [] nArgv;
+    }
 
 #if !NODE_VERSION_AT_LEAST(0, 5, 0)
     if (try_catch.HasCaught()) {
@@ -51,3 +80,28 @@ bool node_db::EventEmitter::Emit(const char* event, int argc, v8::Handle<v8::Val
 
     return true;
 }
+
+bool node_db::EventEmitter::HasListeners(const char* event) {
+    v8::HandleScope scope;
+    return this->HasListeners(v8::String::NewSymbol(event));
+}
+
+bool node_db::EventEmitter::HasListeners(v8::Handle<v8::String> event) {
+    v8::HandleScope scope;
+
+    // Listeners are looked up in _events, which holds a function or an array
+    // of them per event. Calling listeners() instead would create the entry
+    v8::Local<v8::Value> events = this->handle_->Get(syEvents);
+    if (!events->IsObject()) {
+        return false;
+    }
+
+    v8::Local<v8::Value> listeners = events->ToObject()->Get(event);
+    if (listeners->IsFunction()) {
+        return true;
+    } else if (listeners->IsArray()) {
+        return (v8::Local<v8::Array>::Cast(listeners)->Length() > 0);
+    }
+
+    return false;
+}
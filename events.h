@@ -13,12 +13,20 @@ class EventEmitter : public node::ObjectWrap {
         static void Init();
 
     protected:
-#if !NODE_VERSION_AT_LEAST(0, 5, 0)
+        static const int maxStackArguments = 8;
         static v8::Persistent<v8::String> syEmit;
-#endif
+        static v8::Persistent<v8::String> syEvents;
+        static v8::Persistent<v8::String> syBatch;
+        static v8::Persistent<v8::String> syEach;
+        static v8::Persistent<v8::String> syError;
+        static v8::Persistent<v8::String> syReady;
+        static v8::Persistent<v8::String> sySuccess;
 
         EventEmitter();
         bool Emit(const char* event, int argc,  v8::Handle<v8::Value> argv[]);
+        bool Emit(v8::Handle<v8::String> event, int argc,  v8::Handle<v8::Value> argv[]);
+        bool HasListeners(const char* event);
+        bool HasListeners(v8::Handle<v8::String> event);
 };
 }
 
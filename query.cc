@@ -1,9 +1,16 @@
 // Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
 // Copyright 2011 Georg Wicherski <gw@oxff.net>
 #include "./query.h"
+#include "./cursor.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-bool node_db::Query::gmtDeltaLoaded = false;
-int node_db::Query::gmtDelta;
+pthread_mutex_t node_db::Query::zonesLock = PTHREAD_MUTEX_INITIALIZER;
+node_db::Query::zones_t node_db::Query::zones;
+pthread_mutex_t node_db::Query::templatesLock = PTHREAD_MUTEX_INITIALIZER;
+std::map<char, node_db::Query::templates_t> node_db::Query::templates;
+node_db::Query::templates_usage_t node_db::Query::templatesUsage;
 
 uv_async_t node_db::Query::g_async;
 
@@ -30,17 +37,22 @@ void node_db::Query::Init(v8::Handle<v8::Object> target, v8::Persistent<v8::Func
     NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "delete", Delete);
     NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "sql", Sql);
     NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "execute", Execute);
+    NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "pause", Pause);
+    NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "resume", Resume);
+
+    node_db::EventEmitter::Init();
+    node_db::Cursor::Init();
+
+    // The time zone is loaded here, on the main thread, so workers resolving
+    // local dates only ever read it
+    tzset();
 }
 
 node_db::Query::Query(): node_db::EventEmitter(),
-    connection(NULL), async(true), cast(true), bufferText(false), cbStart(NULL), cbExecute(NULL), cbFinish(NULL) {
+    connection(NULL), async(true), cast(true), bufferText(false), stream(false), batchSize(1000), maxRows(0), maxResultBytes(0), highWaterMark(0), highWaterBytes(0), pauseTimeout(60000), paused(false), streaming(NULL), columnar(false), rowsAsArray(false), lazy(false), cursor(false), collect(true), prepare(false), interpolated(false), bigintAsNumber(false), utc(false), cbStart(NULL), cbExecute(NULL), cbFinish(NULL) {
 }
 
 node_db::Query::~Query() {
-    for (std::vector< v8::Persistent<v8::Value> >::iterator iterator = this->values.begin(), end = this->values.end(); iterator != end; ++iterator) {
-        iterator->Dispose();
-    }
-
     if (this->cbStart != NULL) {
         node::cb_destroy(this->cbStart);
     }
@@ -56,6 +68,11 @@ void node_db::Query::setConnection(node_db::Connection* connection) {
     this->connection = connection;
 }
 
+void node_db::Query::setLimits(uint32_t maxRows, uint32_t maxResultBytes) {
+    this->maxRows = maxRows;
+    this->maxResultBytes = maxResultBytes;
+}
+
 v8::Handle<v8::Value> node_db::Query::Select(const v8::Arguments& args) {
     v8::HandleScope scope;
 
@@ -87,13 +104,20 @@ v8::Handle<v8::Value> node_db::Query::Select(const v8::Arguments& args) {
                 query->sql << ",";
             }
 
+            // Field objects write their values into the SQL, as insert() does
+            v8::Local<v8::Value> field = fields->Get(i);
+            if (field->IsObject()) {
+                query->interpolated = true;
+            }
+
             try {
-                query->sql << query->fieldName(fields->Get(i));
+                query->sql << query->fieldName(field);
             } catch(const node_db::Exception& exception) {
                 THROW_EXCEPTION(exception.what())
             }
         }
     } else if (args[0]->IsObject()) {
+        query->interpolated = true;
         try {
             query->sql << query->fieldName(args[0]);
         } catch(const node_db::Exception& exception) {
@@ -188,9 +212,10 @@ v8::Handle<v8::Value> node_db::Query::Join(const v8::Arguments& args) {
         v8::String::Utf8Value conditions(join->Get(conditions_key)->ToObject());
         std::string currentConditions = *conditions;
         if (args.Length() > 1) {
-            v8::Local<v8::Array> currentValues = v8::Array::Cast(*args[1]);
-            for (uint32_t i = 0, limiti = currentValues->Length(); i < limiti; i++) {
-                query->values.push_back(v8::Persistent<v8::Value>::New(currentValues->Get(i)));
+            try {
+                query->bindValues(v8::Local<v8::Array>::Cast(args[1]));
+            } catch(const node_db::Exception& exception) {
+                THROW_EXCEPTION(exception.what())
             }
         }
 
@@ -485,6 +510,7 @@ v8::Handle<v8::Value> node_db::Query::Insert(const v8::Arguments& args) {
                 bool multipleRecords = values->Get(0)->IsArray();
 
                 query->sql << "VALUES ";
+                query->interpolated = true;
                 if (!multipleRecords) {
                     query->sql << "(";
                 }
@@ -559,6 +585,7 @@ v8::Handle<v8::Value> node_db::Query::Set(const v8::Arguments& args) {
     }
 
     query->sql << " SET ";
+    query->interpolated = true;
 
     v8::Local<v8::Object> values = args[0]->ToObject();
     v8::Local<v8::Array> valueProperties = values->GetPropertyNames();
@@ -592,6 +619,42 @@ v8::Handle<v8::Value> node_db::Query::Sql(const v8::Arguments& args) {
     return scope.Close(v8::String::New(query->sql.str().c_str()));
 }
 
+v8::Handle<v8::Value> node_db::Query::Pause(const v8::Arguments& args) {
+    v8::HandleScope scope;
+
+    node_db::Query *query = node::ObjectWrap::Unwrap<node_db::Query>(args.This());
+    assert(query);
+
+    query->paused = true;
+
+    return scope.Close(v8::Undefined());
+}
+
+v8::Handle<v8::Value> node_db::Query::Resume(const v8::Arguments& args) {
+    v8::HandleScope scope;
+
+    node_db::Query *query = node::ObjectWrap::Unwrap<node_db::Query>(args.This());
+    assert(query);
+
+    if (!query->paused) {
+        return scope.Close(v8::Undefined());
+    }
+
+    query->paused = false;
+
+    // When called from an each or batch handler, the loop delivering batches
+    // continues once the handler returns
+    execute_request_t* request = query->streaming;
+    if (request != NULL && !request->draining) {
+        query->streamBatches(request);
+        if (request->finished && !query->paused) {
+            query->executeFinished(request);
+        }
+    }
+
+    return scope.Close(v8::Undefined());
+}
+
 v8::Handle<v8::Value> node_db::Query::Execute(const v8::Arguments& args) {
     v8::HandleScope scope;
 
@@ -608,7 +671,11 @@ v8::Handle<v8::Value> node_db::Query::Execute(const v8::Arguments& args) {
     std::string sql;
 
     try {
-        sql = query->parseQuery();
+        if (query->prepare) {
+            sql = query->parseStatement();
+        } else {
+            sql = query->parseQuery();
+        }
     } catch(const node_db::Exception& exception) {
         THROW_EXCEPTION(exception.what())
     }
@@ -637,6 +704,18 @@ v8::Handle<v8::Value> node_db::Query::Execute(const v8::Arguments& args) {
         THROW_EXCEPTION("Can't execute a query without being connected")
     }
 
+    if (query->async && query->stream && query->columnar) {
+        THROW_EXCEPTION("Columnar layout can't be used when streaming rows")
+    }
+
+    if (query->lazy && (query->columnar || query->rowsAsArray)) {
+        THROW_EXCEPTION("Lazy rows can only be used with object rows")
+    }
+
+    if (query->cursor && (!query->async || query->stream)) {
+        THROW_EXCEPTION("Cursors can only be used with asynchronous, non streamed queries")
+    }
+
     execute_request_t *request = new execute_request_t();
     if (request == NULL) {
         THROW_EXCEPTION("Could not create EIO request")
@@ -650,12 +729,40 @@ v8::Handle<v8::Value> node_db::Query::Execute(const v8::Arguments& args) {
     request->query = query;
     request->buffered = false;
     request->result = NULL;
+    request->columns = NULL;
+    request->parsers = NULL;
+    request->arena = NULL;
     request->rows = NULL;
     request->error = NULL;
+    request->index = 0;
+    request->stream = NULL;
+    request->batches = NULL;
+    request->fetchedRows = 0;
+    request->fetchedBytes = 0;
+    request->queuedRows = 0;
+    request->queuedBytes = 0;
+    request->finished = false;
+
+    // By default a streamed query keeps up to streamWindow batches in memory
+    request->highWaterMark = (query->highWaterMark > 0 ? query->highWaterMark : static_cast<uint64_t>(Query::streamWindow) * query->batchSize);
+    request->highWaterBytes = query->highWaterBytes;
+    request->pauseTimeout = query->pauseTimeout;
+    request->draining = false;
+    query->paused = false;
 
     if (query->async) {
         request->query->Ref();
 
+        if (query->stream) {
+            request->stream = new uv_async_t();
+            request->stream->data = request;
+            request->batches = new std::deque<batch_t*>();
+            pthread_mutex_init(&(request->batchesLock), NULL);
+            pthread_cond_init(&(request->batchesCondition), NULL);
+            uv_async_init(uv_default_loop(), request->stream, uvExecuteStream);
+            query->streaming = request;
+        }
+
         uv_work_t* req = new uv_work_t();
         req->data = request;
         uv_queue_work(uv_default_loop(), req, uvExecute, (uv_after_work_cb)uvExecuteFinished);
@@ -677,119 +784,591 @@ void node_db::Query::uvExecute(uv_work_t* uvRequest) {
     execute_request_t *request = static_cast<execute_request_t *>(uvRequest->data);
     assert(request);
 
+    // Fetching rows can throw after the connection was unlocked, so the lock
+    // is only released here if it is still held
+    bool locked = false, reading = false;
     try {
         request->query->connection->lock();
+        locked = true;
+        if (request->query->connection->isBusy()) {
+            throw node_db::Exception("Can't execute a query while another result is being read from the connection");
+        }
         request->result = request->query->execute();
+
+        // An unbuffered result is read after the lock is released, so it keeps
+        // the connection to itself until it is fetched, or until its cursor is
+        // closed or drained. That includes a stream waiting while paused
+        if (request->result != NULL && !request->result->isEmpty() && !request->result->isBuffered()) {
+            request->query->connection->setBusy(true);
+            reading = true;
+        }
         request->query->connection->unlock();
+        locked = false;
 
         if (!request->result->isEmpty() && request->result != NULL) {
-            request->rows = new std::vector<row_t*>();
-            if (request->rows == NULL) {
-                throw node_db::Exception("Could not create buffer for rows");
-            }
-
-            request->buffered = request->result->isBuffered();
-            request->columnCount = request->result->columnCount();
-            while (request->result->hasNext()) {
-                unsigned long* columnLengths = request->result->columnLengths();
-                char** currentRow = request->result->next();
+            if (request->query->cursor) {
+                // Rows are left in the result, the cursor fetches them on demand
+                request->buffered = request->result->isBuffered();
+                request->columnCount = request->result->columnCount();
+                Query::prepareParsers(request);
+            } else {
+                Query::fetchRows(request);
 
-                row_t* row = new row_t();
-                if (row == NULL) {
-                    throw node_db::Exception("Could not create buffer for row");
+                if (!request->result->isBuffered()) {
+                    request->result->release();
                 }
 
-                row->columnLengths = new unsigned long[request->columnCount];
-                if (row->columnLengths == NULL) {
-                    throw node_db::Exception("Could not create buffer for column lengths");
+                if (reading) {
+                    request->query->connection->lock();
+                    request->query->connection->setBusy(false);
+                    request->query->connection->unlock();
+                    reading = false;
                 }
+            }
+        }
+    } catch(const node_db::Exception& exception) {
+        if (!locked && reading) {
+            request->query->connection->lock();
+            locked = true;
+        }
+        if (reading) {
+            request->query->connection->setBusy(false);
+        }
+        if (locked) {
+            request->query->connection->unlock();
+        }
+        Query::freeRequest(request, false);
+        request->error = new std::string(exception.what());
+    }
+}
 
-                if (request->buffered) {
-                    row->columns = currentRow;
+void node_db::Query::fetchRows(execute_request_t* request) throw(node_db::Exception&) {
+    request->buffered = request->result->isBuffered();
+    request->columnCount = request->result->columnCount();
 
-                    for (uint16_t i = 0; i < request->columnCount; i++) {
-                        row->columnLengths[i] = columnLengths[i];
-                    }
-                } else {
-                    row->columns = new char*[request->columnCount];
-                    if (row->columns == NULL) {
-                        throw node_db::Exception("Could not create buffer for columns");
-                    }
+    Query::prepareParsers(request);
 
-                    for (uint16_t i = 0; i < request->columnCount; i++) {
-                        row->columnLengths[i] = columnLengths[i];
-                        if (currentRow[i] != NULL) {
-                            row->columns[i] = new char[row->columnLengths[i]];
-                            if (row->columns[i] == NULL) {
-                                throw node_db::Exception("Could not create buffer for column");
-                            }
-                            memcpy(row->columns[i], currentRow[i], row->columnLengths[i]);
-                        } else {
-                            row->columns[i] = NULL;
-                        }
-                    }
-                }
+    if (request->stream == NULL) {
+        request->arena = new node_db::Arena();
+        request->rows = new std::vector<row_t*>();
+        if (request->arena == NULL || request->rows == NULL) {
+            throw node_db::Exception("Could not create buffer for rows");
+        }
 
-                request->rows->push_back(row);
-            }
+        while (request->result->hasNext()) {
+            request->rows->push_back(Query::copyRow(request, request->arena));
+            Query::checkLimits(request, request->rows->back());
+        }
+        return;
+    }
+
+    bool hasNext = request->result->hasNext();
+    while (hasNext) {
+        batch_t* batch = new batch_t();
+        if (batch == NULL) {
+            throw node_db::Exception("Could not create buffer for rows");
+        }
 
-            if (!request->result->isBuffered()) {
-                request->result->release();
+        batch->arena = new node_db::Arena();
+        batch->rows = new std::vector<row_t*>();
+        batch->rows->reserve(request->query->batchSize);
+        batch->last = false;
+
+        uint64_t fetchedBytes = request->fetchedBytes;
+        try {
+            while (hasNext && batch->rows->size() < request->query->batchSize) {
+                batch->rows->push_back(Query::copyRow(request, batch->arena));
+                Query::checkLimits(request, batch->rows->back());
+                hasNext = request->result->hasNext();
             }
+        } catch(const node_db::Exception& exception) {
+            Query::freeRows(batch->rows, batch->arena);
+            delete batch;
+            throw;
         }
-    } catch(const node_db::Exception& exception) {
-        request->query->connection->unlock();
-        Query::freeRequest(request, false);
-        request->error = new std::string(exception.what());
+
+        batch->bytes = request->fetchedBytes - fetchedBytes;
+        batch->last = !hasNext;
+        Query::pushBatch(request, batch);
     }
 }
 
-void node_db::Query::uvExecuteFinished(uv_work_t* uvRequest, int status) {
+node_db::Query::row_t* node_db::Query::copyRow(execute_request_t* request, node_db::Arena* arena) throw(node_db::Exception&) {
+    unsigned long* columnLengths = request->result->columnLengths();
+    char** currentRow = request->result->next();
+
+    row_t* row = static_cast<row_t*>(arena->allocate(sizeof(row_t)));
+    row->columnLengths = static_cast<unsigned long*>(arena->allocate(request->columnCount * sizeof(unsigned long)));
+    memcpy(row->columnLengths, columnLengths, request->columnCount * sizeof(unsigned long));
+
+    // Only copied values belong to the arena and can be handed out as Buffers
+    // without copying them again, buffered ones go away with the result. Lazy
+    // rows always copy, as they are decoded after the result is released
+    row->arena = NULL;
+    if (request->buffered && !request->query->lazy) {
+        row->columns = currentRow;
+    } else {
+        row->arena = arena;
+        row->columns = static_cast<char**>(arena->allocate(request->columnCount * sizeof(char*)));
+        for (uint16_t i = 0; i < request->columnCount; i++) {
+            row->columns[i] = (currentRow[i] != NULL ? arena->copy(currentRow[i], row->columnLengths[i]) : NULL);
+        }
+    }
+
+    row->cells = NULL;
+    if (request->parsers != NULL) {
+        row->cells = static_cast<cell_t*>(arena->allocate(request->columnCount * sizeof(cell_t)));
+        Query::parseRow(request, row);
+    }
+
+    return row;
+}
+
+void node_db::Query::checkLimits(execute_request_t* request, const row_t* row) throw(node_db::Exception&) {
+    request->fetchedRows++;
+    for (uint16_t i = 0; i < request->columnCount; i++) {
+        request->fetchedBytes += row->columnLengths[i];
+    }
+
+    const char* limit = NULL;
+    uint64_t maximum = 0;
+    if (request->query->maxRows > 0 && request->fetchedRows > request->query->maxRows) {
+        limit = "rows";
+        maximum = request->query->maxRows;
+    } else if (request->query->maxResultBytes > 0 && request->fetchedBytes > request->query->maxResultBytes) {
+        limit = "bytes";
+        maximum = request->query->maxResultBytes;
+    }
+
+    if (limit != NULL) {
+        // Whatever was fetched is freed by the caller, the result is released
+        // here so the connection is usable again
+        if (!request->buffered) {
+            request->result->release();
+        }
+
+        std::ostringstream message;
+        message << "Result too large: exceeds the maximum of " << maximum << " " << limit;
+        throw node_db::Exception(message.str());
+    }
+}
+
+void node_db::Query::prepareParsers(execute_request_t* request) throw(node_db::Exception&) {
+    if (request->parsers != NULL) {
+        return;
+    }
+
+    // Values that need parsing are converted here, on the thread fetching
+    // rows, so the main thread is only left with creating the V8 values
+    std::vector<node_db::Result::Column::info_t> columns = request->result->columns();
+
+    request->parsers = new parse_t[request->columnCount];
+    for (uint16_t j = 0; j < request->columnCount; j++) {
+        if (!request->query->cast) {
+            request->parsers[j] = Query::parseText;
+            continue;
+        }
+
+        switch (columns[j].type) {
+            case node_db::Result::Column::INT:
+                request->parsers[j] = Query::parseInteger;
+                break;
+            case node_db::Result::Column::NUMBER:
+                request->parsers[j] = Query::parseNumber;
+                break;
+            case node_db::Result::Column::BIGINT:
+                request->parsers[j] = request->query->bigintAsNumber ? Query::parseInteger : Query::parseBigint;
+                break;
+            case node_db::Result::Column::TIME:
+                request->parsers[j] = Query::parseTime;
+                break;
+            case node_db::Result::Column::DATE:
+                request->parsers[j] = request->query->utc ? Query::parseUtcDate : Query::parseDate;
+                break;
+            case node_db::Result::Column::DATETIME:
+                request->parsers[j] = request->query->utc ? Query::parseUtcDatetime : Query::parseDatetime;
+                break;
+            case node_db::Result::Column::BOOL:
+            case node_db::Result::Column::SET:
+                request->parsers[j] = NULL;
+                break;
+            case node_db::Result::Column::TEXT:
+                request->parsers[j] = (request->query->bufferText || columns[j].binary ? NULL : Query::parseText);
+                break;
+            default:
+                request->parsers[j] = Query::parseText;
+                break;
+        }
+    }
+}
+
+void node_db::Query::parseRow(execute_request_t* request, row_t* row) {
+    for (uint16_t j = 0; j < request->columnCount; j++) {
+        cell_t* cell = &(row->cells[j]);
+        cell->parsed = false;
+        if (request->parsers[j] != NULL && row->columns[j] != NULL) {
+            cell->parsed = request->parsers[j](row->columns[j], row->columnLengths[j], cell, &(request->zones));
+        }
+    }
+}
+
+void node_db::Query::pushBatch(execute_request_t* request, batch_t* batch) throw(node_db::Exception&) {
+    // Fetching blocks once the queued rows reach the high-water mark, which is
+    // also how a paused query stops its producer: it simply stops consuming.
+    // The wait holds a threadpool thread, so it is bounded by pauseTimeout
+    struct timespec deadline;
+    if (request->pauseTimeout > 0) {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        deadline.tv_sec = now.tv_sec + request->pauseTimeout / 1000;
+        deadline.tv_nsec = now.tv_usec * 1000 + static_cast<long>(request->pauseTimeout % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    bool timedOut = false;
+    pthread_mutex_lock(&(request->batchesLock));
+    while (!request->batches->empty()
+        && (request->queuedRows >= request->highWaterMark
+            || (request->highWaterBytes > 0 && request->queuedBytes >= request->highWaterBytes))) {
+        if (request->pauseTimeout == 0) {
+            pthread_cond_wait(&(request->batchesCondition), &(request->batchesLock));
+        } else if (pthread_cond_timedwait(&(request->batchesCondition), &(request->batchesLock), &deadline) == ETIMEDOUT) {
+            timedOut = true;
+            break;
+        }
+    }
+    if (!timedOut) {
+        request->batches->push_back(batch);
+        request->queuedRows += batch->rows->size();
+        request->queuedBytes += batch->bytes;
+    }
+    pthread_mutex_unlock(&(request->batchesLock));
+
+    if (timedOut) {
+        Query::freeRows(batch->rows, batch->arena);
+        delete batch;
+
+        // Whatever was queued is still delivered, the result is released so
+        // the connection is usable again
+        if (!request->buffered) {
+            request->result->release();
+        }
+
+        std::ostringstream message;
+        message << "Streamed rows were not consumed within " << request->pauseTimeout << " ms";
+        throw node_db::Exception(message.str());
+    }
+
+    uv_async_send(request->stream);
+}
+
+node_db::Query::batch_t* node_db::Query::popBatch(execute_request_t* request) {
+    batch_t* batch = NULL;
+
+    pthread_mutex_lock(&(request->batchesLock));
+    if (!request->batches->empty()) {
+        batch = request->batches->front();
+        request->batches->pop_front();
+        request->queuedRows -= batch->rows->size();
+        request->queuedBytes -= batch->bytes;
+        pthread_cond_signal(&(request->batchesCondition));
+    }
+    pthread_mutex_unlock(&(request->batchesLock));
+
+    return batch;
+}
+
+void node_db::Query::uvExecuteStream(uv_async_t* uvAsync, int status) {
     v8::HandleScope scope;
 
-    execute_request_t *request = static_cast<execute_request_t *>(uvRequest->data);
-    assert(request);
+    execute_request_t *request = static_cast<execute_request_t *>(uvAsync->data);
+    if (request == NULL) {
+        return;
+    }
 
-    if (request->error == NULL && request->result != NULL) {
-        v8::Local<v8::Value> argv[3];
-        argv[0] = v8::Local<v8::Value>::New(v8::Null());
+    request->query->streamBatches(request);
+}
 
-        bool isEmpty = request->result->isEmpty();
-        if (!isEmpty) {
-            assert(request->rows);
+void node_db::Query::uvStreamClosed(uv_handle_t* uvHandle) {
+    delete reinterpret_cast<uv_async_t*>(uvHandle);
+}
 
-            size_t totalRows = request->rows->size();
-            v8::Local<v8::Array> rows = v8::Array::New(totalRows);
+void node_db::Query::streamBatches(execute_request_t* request) {
+    batch_t* batch;
 
-            uint64_t index = 0;
-            std::ostringstream reusableStream;
-            for (std::vector<row_t*>::iterator iterator = request->rows->begin(), end = request->rows->end(); iterator != end; ++iterator, index++) {
-                row_t* currentRow = *iterator;
-                v8::Local<v8::Object> row = request->query->row(request->result, currentRow);
+    // Handlers calling pause() and resume() run inside this loop, which then
+    // simply carries on, and its caller decides whether the query finished
+    if (request->draining) {
+        return;
+    }
+    request->draining = true;
+
+    while (!this->paused && (batch = Query::popBatch(request)) != NULL) {
+        v8::HandleScope scope;
+
+        this->emitRows(request, *(batch->rows), batch->last);
+
+        Query::freeRows(batch->rows, batch->arena);
+        delete batch;
+    }
+
+    request->draining = false;
+}
+
+v8::Local<v8::Array> node_db::Query::emitRows(execute_request_t* request, const std::vector<row_t*>& rows, bool last) {
+    this->prepareColumns(request);
+
+    // Streamed rows are only delivered through events, so that memory stays
+    // bounded by the batches in flight
+    uint32_t totalRows = rows.size();
+    bool collect = (this->collect && request->batches == NULL);
+    v8::Local<v8::Array> jsRows;
+    if (collect) {
+        jsRows = v8::Array::New(totalRows);
+    }
+
+    // Lazy rows share a holder object that keeps their arena alive until
+    // every row created from it has been collected
+    lazy_t* lazy = NULL;
+    v8::Local<v8::Object> holder;
+    if (this->lazy && totalRows > 0) {
+        Arena* arena = rows[0]->arena;
+        lazy = static_cast<lazy_t*>(arena->allocate(sizeof(lazy_t)));
+        lazy->arena = arena;
+        lazy->casts = static_cast<cast_t*>(arena->allocate(request->columnCount * sizeof(cast_t)));
+        for (uint16_t j = 0; j < request->columnCount; j++) {
+            lazy->casts[j] = request->columns[j].cast;
+        }
+        arena->share();
+
+        holder = v8::Object::New();
+        v8::Persistent<v8::Object>::New(holder).MakeWeak(lazy, Query::releaseLazyRows);
+    }
+
+    bool emitEach = this->HasListeners(syEach);
+    bool emitBatch = this->HasListeners(syBatch);
+
+    // Rows are created a batch at a time in their own handle scope, so rows
+    // that are not collected can be garbage collected once delivered
+    std::ostringstream reusableStream;
+    for (uint32_t offset = 0; offset < totalRows; offset += this->batchSize) {
+        v8::HandleScope scope;
+
+        uint32_t count = std::min(this->batchSize, totalRows - offset);
+        v8::Local<v8::Array> batch;
+        if (emitBatch) {
+            batch = v8::Array::New(count);
+        }
+
+        for (uint32_t i = offset; i < offset + count; i++) {
+            v8::Local<v8::Object> row = (lazy != NULL ? this->lazyRow(request, rows[i], lazy, holder) : this->row(request, rows[i]));
+
+            if (emitEach) {
                 v8::Local<v8::Value> eachArgv[3];
 
                 eachArgv[0] = row;
-                eachArgv[1] = v8StringFromUInt64(index, reusableStream);
-                eachArgv[2] = v8::Local<v8::Value>::New((index == totalRows - 1) ? v8::True() : v8::False());
+                eachArgv[1] = v8StringFromUInt64(request->index, reusableStream);
+                eachArgv[2] = v8::Local<v8::Value>::New((last && i == totalRows - 1) ? v8::True() : v8::False());
 
-                request->query->Emit("each", 3, eachArgv);
+                this->Emit(syEach, 3, eachArgv);
+            }
+            request->index++;
 
-                rows->Set(index, row);
+            if (emitBatch) {
+                batch->Set(i - offset, row);
             }
+            if (collect) {
+                jsRows->Set(i, row);
+            }
+        }
 
-            v8::Local<v8::Array> columns = v8::Array::New(request->columnCount);
-            for (uint16_t j = 0; j < request->columnCount; j++) {
-                node_db::Result::Column *currentColumn = request->result->column(j);
+        if (emitBatch) {
+            v8::Local<v8::Value> argv[2];
+            argv[0] = batch;
+            argv[1] = v8::Local<v8::Value>::New((last && offset + count == totalRows) ? v8::True() : v8::False());
+            this->Emit(syBatch, 2, argv);
+        }
+    }
+
+    return jsRows;
+}
+
+v8::Local<v8::Array> node_db::Query::emitResult(execute_request_t* request) throw(node_db::Exception&) {
+    request->buffered = request->result->isBuffered();
+    request->columnCount = request->result->columnCount();
+
+    Query::prepareParsers(request);
+    this->prepareColumns(request);
+
+    // Rows are turned into V8 values straight from the result, so nothing is
+    // copied into an arena when the query runs on the main thread
+    v8::Local<v8::Array> jsRows;
+    if (this->collect) {
+        jsRows = v8::Array::New();
+    }
+
+    std::vector<cell_t> cells(request->parsers != NULL ? request->columnCount : 0);
+    row_t currentRow;
+    currentRow.arena = NULL;
+    currentRow.cells = (!cells.empty() ? &cells[0] : NULL);
+
+    bool emitEach = this->HasListeners(syEach);
+    bool emitBatch = this->HasListeners(syBatch);
+
+    std::ostringstream reusableStream;
+    uint32_t total = 0;
+    bool hasNext = request->result->hasNext();
+    while (hasNext) {
+        v8::HandleScope scope;
+
+        v8::Local<v8::Array> batch;
+        if (emitBatch) {
+            batch = v8::Array::New();
+        }
+
+        uint32_t count = 0;
+        while (hasNext && count < this->batchSize) {
+            currentRow.columnLengths = request->result->columnLengths();
+            currentRow.columns = request->result->next();
+            if (currentRow.cells != NULL) {
+                Query::parseRow(request, &currentRow);
+            }
+            Query::checkLimits(request, &currentRow);
+
+            // The row is only valid until the next one is fetched
+            v8::Local<v8::Object> row = this->row(request, &currentRow);
+            hasNext = request->result->hasNext();
+
+            if (emitEach) {
+                v8::Local<v8::Value> eachArgv[3];
+
+                eachArgv[0] = row;
+                eachArgv[1] = v8StringFromUInt64(request->index, reusableStream);
+                eachArgv[2] = v8::Local<v8::Value>::New(!hasNext ? v8::True() : v8::False());
 
-                v8::Local<v8::Object> column = v8::Object::New();
-                column->Set(v8::String::New("name"), v8::String::New(currentColumn->getName().c_str()));
-                column->Set(v8::String::New("type"), NODE_CONSTANT(currentColumn->getType()));
+                this->Emit(syEach, 3, eachArgv);
+            }
+            request->index++;
 
-                columns->Set(j, column);
+            if (emitBatch) {
+                batch->Set(count, row);
             }
+            if (this->collect) {
+                jsRows->Set(total, row);
+            }
+            count++;
+            total++;
+        }
+
+        if (emitBatch) {
+            v8::Local<v8::Value> argv[2];
+            argv[0] = batch;
+            argv[1] = v8::Local<v8::Value>::New(!hasNext ? v8::True() : v8::False());
+            this->Emit(syBatch, 2, argv);
+        }
+    }
+
+    return jsRows;
+}
+
+void node_db::Query::prepareColumns(execute_request_t* request) const {
+    if (request->columns != NULL) {
+        return;
+    }
+
+    // Column names are turned into symbols once per result, and every row is
+    // created from a template declaring them so all rows share the same map
+    v8::Local<v8::ObjectTemplate> rowTemplate = v8::ObjectTemplate::New();
+    if (this->lazy) {
+        rowTemplate->SetInternalFieldCount(Query::lazyFields + request->columnCount);
+    }
+
+    std::vector<node_db::Result::Column::info_t> columns = request->result->columns();
+
+    request->columns = new column_t[request->columnCount];
+    for (uint16_t j = 0; j < request->columnCount; j++) {
+        v8::Local<v8::String> name = v8::String::NewSymbol(columns[j].name.c_str());
+        request->columns[j].name = v8::Persistent<v8::String>::New(name);
+        request->columns[j].type = columns[j].type;
+        request->columns[j].cast = this->caster(columns[j]);
+        if (this->lazy) {
+            rowTemplate->SetAccessor(name, Query::GetLazyColumn, Query::SetLazyColumn, v8::Integer::New(j));
+        } else {
+            rowTemplate->Set(name, v8::Null());
+        }
+    }
+
+    request->rowTemplate = v8::Persistent<v8::ObjectTemplate>::New(rowTemplate);
+}
+
+v8::Local<v8::Array> node_db::Query::columns(execute_request_t* request) const {
+    this->prepareColumns(request);
+
+    v8::Local<v8::Array> columns = v8::Array::New(request->columnCount);
+    for (uint16_t j = 0; j < request->columnCount; j++) {
+        v8::Local<v8::Object> column = v8::Object::New();
+        column->Set(v8::String::New("name"), request->columns[j].name);
+        column->Set(v8::String::New("type"), NODE_CONSTANT(request->columns[j].type));
+
+        columns->Set(j, column);
+    }
+    return columns;
+}
+
+void node_db::Query::uvExecuteFinished(uv_work_t* uvRequest, int status) {
+    v8::HandleScope scope;
+
+    execute_request_t *request = static_cast<execute_request_t *>(uvRequest->data);
+    assert(request);
+
+    if (request->stream != NULL) {
+        request->query->streamBatches(request);
 
-            argv[1] = rows;
-            argv[2] = columns;
+        // A paused query is finished by resume(), once every batch was delivered
+        request->finished = true;
+        if (request->query->paused) {
+            return;
+        }
+    }
+
+    request->query->executeFinished(request);
+}
+
+void node_db::Query::executeFinished(execute_request_t* request) {
+    if (request->stream != NULL) {
+        request->stream->data = NULL;
+        uv_close(reinterpret_cast<uv_handle_t*>(request->stream), uvStreamClosed);
+        request->stream = NULL;
+        this->streaming = NULL;
+    }
+
+    bool cursor = false;
+    if (request->error == NULL && request->result != NULL) {
+        v8::Local<v8::Value> argv[3];
+        argv[0] = v8::Local<v8::Value>::New(v8::Null());
+
+        bool isEmpty = request->result->isEmpty();
+        if (!isEmpty) {
+            if (request->query->cursor) {
+                argv[1] = node_db::Cursor::create(request);
+                cursor = true;
+            } else if (request->batches != NULL) {
+                argv[1] = v8::Local<v8::Value>::New(v8::Null());
+            } else {
+                assert(request->rows);
+                if (request->query->columnar) {
+                    argv[1] = request->query->columnarRows(request, *(request->rows));
+                } else {
+                    argv[1] = request->query->emitRows(request, *(request->rows), true);
+                    if (argv[1].IsEmpty()) {
+                        argv[1] = v8::Local<v8::Value>::New(v8::Null());
+                    }
+                }
+            }
+            argv[2] = request->query->columns(request);
         } else {
             v8::Local<v8::Object> result = v8::Object::New();
             std::ostringstream reusableStream;
@@ -799,7 +1378,7 @@ void node_db::Query::uvExecuteFinished(uv_work_t* uvRequest, int status) {
             argv[1] = result;
         }
 
-        request->query->Emit("success", !isEmpty ? 2 : 1, &argv[1]);
+        request->query->Emit(sySuccess, !isEmpty ? 2 : 1, &argv[1]);
 
         if (request->query->cbExecute != NULL && !request->query->cbExecute->IsEmpty()) {
             v8::TryCatch tryCatch;
@@ -812,7 +1391,7 @@ void node_db::Query::uvExecuteFinished(uv_work_t* uvRequest, int status) {
         v8::Local<v8::Value> argv[1];
         argv[0] = v8::String::New(request->error != NULL ? request->error->c_str() : "(unknown error)");
 
-        request->query->Emit("error", 1, argv);
+        request->query->Emit(syError, 1, argv);
 
         if (request->query->cbExecute != NULL && !request->query->cbExecute->IsEmpty()) {
             v8::TryCatch tryCatch;
@@ -839,15 +1418,29 @@ void node_db::Query::uvExecuteFinished(uv_work_t* uvRequest, int status) {
 
     request->query->Unref();
 
-    Query::freeRequest(request);
+    if (!cursor) {
+        Query::freeRequest(request);
+    }
 }
 
 void node_db::Query::executeAsync(execute_request_t* request) {
-    bool freeAll = true;
+    bool locked = false, reading = false;
     try {
         this->connection->lock();
+        locked = true;
+        if (this->connection->isBusy()) {
+            throw node_db::Exception("Can't execute a query while another result is being read from the connection");
+        }
         request->result = this->execute();
+
+        // Handlers run while an unbuffered result is read, and may start
+        // other queries on the connection
+        if (request->result != NULL && !request->result->isEmpty() && !request->result->isBuffered()) {
+            this->connection->setBusy(true);
+            reading = true;
+        }
         this->connection->unlock();
+        locked = false;
 
         if (request->result != NULL) {
             v8::Local<v8::Value> argv[3];
@@ -857,47 +1450,34 @@ void node_db::Query::executeAsync(execute_request_t* request) {
             if (!isEmpty) {
                 request->columnCount = request->result->columnCount();
 
-                v8::Local<v8::Array> columns = v8::Array::New(request->columnCount);
-                v8::Local<v8::Array> rows;
-                try {
-                    rows = v8::Array::New(request->result->count());
-                } catch(const node_db::Exception& exception) {
-                    rows = v8::Array::New();
+                v8::Local<v8::Array> columns = this->columns(request);
+                v8::Local<v8::Value> rows;
+                if (this->columnar || this->lazy) {
+                    // Columns need every row up front, and lazy rows outlive
+                    // the result, so both still work from copied rows
+                    Query::fetchRows(request);
+                    if (this->columnar) {
+                        rows = this->columnarRows(request, *(request->rows));
+                    } else {
+                        rows = this->emitRows(request, *(request->rows), true);
+                    }
+                } else {
+                    rows = this->emitResult(request);
+                }
+                if (rows.IsEmpty()) {
+                    rows = v8::Local<v8::Value>::New(v8::Null());
                 }
 
-                for (uint16_t i = 0; i < request->columnCount; i++) {
-                    node_db::Result::Column *currentColumn = request->result->column(i);
-
-                    v8::Local<v8::Object> column = v8::Object::New();
-                    column->Set(v8::String::New("name"), v8::String::New(currentColumn->getName().c_str()));
-                    column->Set(v8::String::New("type"), NODE_CONSTANT(currentColumn->getType()));
-
-                    columns->Set(i, column);
+                if (!request->result->isBuffered()) {
+                    request->result->release();
                 }
 
-                row_t row;
-                uint64_t index = 0;
-                std::ostringstream reusableStream;
-
-                while (request->result->hasNext()) {
-                    row.columnLengths = (unsigned long*) request->result->columnLengths();
-                    row.columns = reinterpret_cast<char**>(request->result->next());
-
-                    v8::Local<v8::Object> jsRow = this->row(request->result, &row);
-                    v8::Local<v8::Value> eachArgv[3];
-
-                    eachArgv[0] = jsRow;
-                    eachArgv[1] = v8StringFromUInt64(index, reusableStream);
-                    eachArgv[2] = v8::Local<v8::Value>::New(request->result->hasNext() ? v8::True() : v8::False());
-
-                    this->Emit("each", 3, eachArgv);
-
-                    rows->Set(index++, jsRow);
-                }
-
-                if (!request->result->isBuffered()) {
-                    request->result->release();
-                }
+                if (reading) {
+                    this->connection->lock();
+                    this->connection->setBusy(false);
+                    this->connection->unlock();
+                    reading = false;
+                }
 
                 argv[1] = rows;
                 argv[2] = columns;
@@ -910,7 +1490,7 @@ void node_db::Query::executeAsync(execute_request_t* request) {
                 argv[1] = result;
             }
 
-            this->Emit("success", !isEmpty ? 2 : 1, &argv[1]);
+            this->Emit(sySuccess, !isEmpty ? 2 : 1, &argv[1]);
 
             if (this->cbExecute != NULL && !this->cbExecute->IsEmpty()) {
                 v8::TryCatch tryCatch;
@@ -921,12 +1501,21 @@ void node_db::Query::executeAsync(execute_request_t* request) {
             }
         }
     } catch(const node_db::Exception& exception) {
-        this->connection->unlock();
+        if (!locked && reading) {
+            this->connection->lock();
+            locked = true;
+        }
+        if (reading) {
+            this->connection->setBusy(false);
+        }
+        if (locked) {
+            this->connection->unlock();
+        }
 
         v8::Local<v8::Value> argv[1];
         argv[0] = v8::String::New(exception.what());
 
-        this->Emit("error", 1, argv);
+        this->Emit(syError, 1, argv);
 
         if (this->cbExecute != NULL && !this->cbExecute->IsEmpty()) {
             v8::TryCatch tryCatch;
@@ -935,34 +1524,32 @@ void node_db::Query::executeAsync(execute_request_t* request) {
                 node::FatalException(tryCatch);
             }
         }
-
-        freeAll = false;
     }
 
-    Query::freeRequest(request, freeAll);
+    // Nothing uses the request once the error was reported, and a result
+    // left by a limit may still hold every buffered row
+    Query::freeRequest(request);
 }
 
 node_db::Result* node_db::Query::execute() const throw(node_db::Exception&) {
+    if (this->prepare) {
+        return this->connection->statement(this->sql.str())->execute(this->values);
+    }
     return this->connection->query(this->sql.str());
 }
 
+void node_db::Query::freeRows(std::vector<row_t*>* rows, node_db::Arena* arena) {
+    delete rows;
+    if (arena != NULL) {
+        arena->release();
+    }
+}
+
 void node_db::Query::freeRequest(execute_request_t* request, bool freeAll) {
     if (request->rows != NULL) {
-        for (std::vector<row_t*>::iterator iterator = request->rows->begin(), end = request->rows->end(); iterator != end; ++iterator) {
-            row_t* row = *iterator;
-            if (!request->buffered) {
-                for (uint16_t i = 0; i < request->columnCount; i++) {
-                    if (row->columns[i] != NULL) {
-                        delete row->columns[i];
-                    }
-                }
-                delete [] row->columns;
-            }
-            delete [] row->columnLengths;
-            delete row;
-        }
-
-        delete request->rows;
+        Query::freeRows(request->rows, request->arena);
+        request->rows = NULL;
+        request->arena = NULL;
     }
 
     if (request->error != NULL) {
@@ -970,6 +1557,29 @@ void node_db::Query::freeRequest(execute_request_t* request, bool freeAll) {
     }
 
     if (freeAll) {
+        if (request->parsers != NULL) {
+            delete [] request->parsers;
+        }
+
+        if (request->columns != NULL) {
+            for (uint16_t j = 0; j < request->columnCount; j++) {
+                request->columns[j].name.Dispose();
+            }
+            delete [] request->columns;
+            request->rowTemplate.Dispose();
+        }
+
+        if (request->batches != NULL) {
+            for (std::deque<batch_t*>::iterator iterator = request->batches->begin(), end = request->batches->end(); iterator != end; ++iterator) {
+                Query::freeRows((*iterator)->rows, (*iterator)->arena);
+                delete *iterator;
+            }
+            delete request->batches;
+
+            pthread_cond_destroy(&(request->batchesCondition));
+            pthread_mutex_destroy(&(request->batchesLock));
+        }
+
         if (request->result != NULL) {
             delete request->result;
         }
@@ -1056,6 +1666,7 @@ v8::Handle<v8::Value> node_db::Query::set(const v8::Arguments& args) {
         this->sql.str("");
         this->sql.clear();
         this->sql << *initialSql;
+        this->interpolated = false;
     }
 
     if (optionsIndex >= 0) {
@@ -1064,6 +1675,21 @@ v8::Handle<v8::Value> node_db::Query::set(const v8::Arguments& args) {
         ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, async);
         ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, cast);
         ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, bufferText);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, stream);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, batchSize);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, maxRows);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, maxResultBytes);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, highWaterMark);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, highWaterBytes);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, pauseTimeout);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_STRING(options, layout);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_STRING(options, rowsAs);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, lazy);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, cursor);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, collect);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, prepare);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_STRING(options, bigint);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_STRING(options, timezone);
         ARG_CHECK_OBJECT_ATTR_OPTIONAL_FUNCTION(options, start);
         ARG_CHECK_OBJECT_ATTR_OPTIONAL_FUNCTION(options, finish);
 
@@ -1079,6 +1705,97 @@ v8::Handle<v8::Value> node_db::Query::set(const v8::Arguments& args) {
             this->bufferText = options->Get(bufferText_key)->IsTrue();
         }
 
+        if (options->Has(stream_key)) {
+            this->stream = options->Get(stream_key)->IsTrue();
+        }
+
+        if (options->Has(batchSize_key)) {
+            this->batchSize = options->Get(batchSize_key)->Uint32Value();
+            if (this->batchSize == 0) {
+                THROW_EXCEPTION("Option \"batchSize\" must be greater than 0")
+            }
+        }
+
+        if (options->Has(maxRows_key)) {
+            this->maxRows = options->Get(maxRows_key)->Uint32Value();
+        }
+
+        if (options->Has(maxResultBytes_key)) {
+            this->maxResultBytes = options->Get(maxResultBytes_key)->Uint32Value();
+        }
+
+        if (options->Has(highWaterMark_key)) {
+            this->highWaterMark = options->Get(highWaterMark_key)->Uint32Value();
+        }
+
+        if (options->Has(highWaterBytes_key)) {
+            this->highWaterBytes = options->Get(highWaterBytes_key)->Uint32Value();
+        }
+
+        if (options->Has(pauseTimeout_key)) {
+            this->pauseTimeout = options->Get(pauseTimeout_key)->Uint32Value();
+        }
+
+        if (options->Has(layout_key)) {
+            v8::String::Utf8Value layout(options->Get(layout_key)->ToString());
+            if (strcmp(*layout, "columnar") == 0) {
+                this->columnar = true;
+            } else if (strcmp(*layout, "rows") == 0) {
+                this->columnar = false;
+            } else {
+                THROW_EXCEPTION("Option \"layout\" must be either \"rows\" or \"columnar\"")
+            }
+        }
+
+        if (options->Has(rowsAs_key)) {
+            v8::String::Utf8Value rowsAs(options->Get(rowsAs_key)->ToString());
+            if (strcmp(*rowsAs, "array") == 0) {
+                this->rowsAsArray = true;
+            } else if (strcmp(*rowsAs, "object") == 0) {
+                this->rowsAsArray = false;
+            } else {
+                THROW_EXCEPTION("Option \"rowsAs\" must be either \"object\" or \"array\"")
+            }
+        }
+
+        if (options->Has(lazy_key)) {
+            this->lazy = options->Get(lazy_key)->IsTrue();
+        }
+
+        if (options->Has(cursor_key)) {
+            this->cursor = options->Get(cursor_key)->IsTrue();
+        }
+
+        if (options->Has(collect_key)) {
+            this->collect = options->Get(collect_key)->IsTrue();
+        }
+
+        if (options->Has(prepare_key)) {
+            this->prepare = options->Get(prepare_key)->IsTrue();
+        }
+
+        if (options->Has(bigint_key)) {
+            v8::String::Utf8Value bigint(options->Get(bigint_key)->ToString());
+            if (strcmp(*bigint, "number") == 0) {
+                this->bigintAsNumber = true;
+            } else if (strcmp(*bigint, "string") == 0) {
+                this->bigintAsNumber = false;
+            } else {
+                THROW_EXCEPTION("Option \"bigint\" must be either \"string\" or \"number\"")
+            }
+        }
+
+        if (options->Has(timezone_key)) {
+            v8::String::Utf8Value timezone(options->Get(timezone_key)->ToString());
+            if (strcmp(*timezone, "utc") == 0) {
+                this->utc = true;
+            } else if (strcmp(*timezone, "local") == 0) {
+                this->utc = false;
+            } else {
+                THROW_EXCEPTION("Option \"timezone\" must be either \"local\" or \"utc\"")
+            }
+        }
+
         if (options->Has(start_key)) {
             if (this->cbStart != NULL) {
                 node::cb_destroy(this->cbStart);
@@ -1095,9 +1812,10 @@ v8::Handle<v8::Value> node_db::Query::set(const v8::Arguments& args) {
     }
 
     if (valuesIndex >= 0) {
-        v8::Local<v8::Array> values = v8::Array::Cast(*args[valuesIndex]);
-        for (uint32_t i = 0, limiti = values->Length(); i < limiti; i++) {
-            this->values.push_back(v8::Persistent<v8::Value>::New(values->Get(i)));
+        try {
+            this->bindValues(v8::Local<v8::Array>::Cast(args[valuesIndex]));
+        } catch(const node_db::Exception& exception) {
+            THROW_EXCEPTION(exception.what())
         }
     }
 
@@ -1156,13 +1874,13 @@ std::string node_db::Query::fieldName(v8::Local<v8::Value> value) const throw(no
                     buffer += ',';
                 }
 
-                buffer += this->value(currentObject->Get(valueKey), false, escape, precision);
+                this->value(&buffer, Query::toValue(currentObject->Get(valueKey), escape, precision));
             } else {
                 if (j > 0) {
                     buffer += ',';
                 }
 
-                buffer += this->value(currentValue, false, currentValue->IsString() ? false : true);
+                this->value(&buffer, Query::toValue(currentValue, currentValue->IsString() ? false : true));
             }
 
             buffer += " AS ";
@@ -1223,6 +1941,13 @@ std::string node_db::Query::tableName(v8::Local<v8::Value> value, bool escape) c
     return buffer;
 }
 
+void node_db::Query::bindValues(v8::Local<v8::Array> values) throw(node_db::Exception&) {
+    // Values are converted as they are bound, so no V8 handles outlive the call
+    for (uint32_t i = 0, limiti = values->Length(); i < limiti; i++) {
+        this->values.push_back(Query::toValue(values->Get(i)));
+    }
+}
+
 v8::Handle<v8::Value> node_db::Query::addCondition(const v8::Arguments& args, const char* separator) {
     ARG_CHECK_STRING(0, conditions);
     ARG_CHECK_OPTIONAL_ARRAY(1, values);
@@ -1230,9 +1955,10 @@ v8::Handle<v8::Value> node_db::Query::addCondition(const v8::Arguments& args, co
     v8::String::Utf8Value conditions(args[0]->ToString());
     std::string currentConditions = *conditions;
     if (args.Length() > 1) {
-        v8::Local<v8::Array> currentValues = v8::Array::Cast(*args[1]);
-        for (uint32_t i = 0, limiti = currentValues->Length(); i < limiti; i++) {
-            this->values.push_back(v8::Persistent<v8::Value>::New(currentValues->Get(i)));
+        try {
+            this->bindValues(v8::Local<v8::Array>::Cast(args[1]));
+        } catch(const node_db::Exception& exception) {
+            THROW_EXCEPTION(exception.what())
         }
     }
 
@@ -1242,123 +1968,728 @@ v8::Handle<v8::Value> node_db::Query::addCondition(const v8::Arguments& args, co
     return args.This();
 }
 
-v8::Local<v8::Object> node_db::Query::row(node_db::Result* result, row_t* currentRow) const {
-    v8::Local<v8::Object> row = v8::Object::New();
+v8::Local<v8::Object> node_db::Query::row(execute_request_t* request, row_t* currentRow) const {
+    if (this->rowsAsArray) {
+        v8::Local<v8::Array> row = v8::Array::New(request->columnCount);
+
+        for (uint16_t j = 0; j < request->columnCount; j++) {
+            if (currentRow->columns[j] != NULL) {
+                row->Set(j, request->columns[j].cast(currentRow->columns[j], currentRow->columnLengths[j], currentRow->cells != NULL ? &(currentRow->cells[j]) : NULL, currentRow->arena));
+            } else {
+                row->Set(j, v8::Null());
+            }
+        }
+
+        return row;
+    }
 
-    for (uint16_t j = 0, limitj = result->columnCount(); j < limitj; j++) {
-        node_db::Result::Column* currentColumn = result->column(j);
-        v8::Local<v8::Value> value;
+    v8::Local<v8::Object> row = request->rowTemplate->NewInstance();
 
+    for (uint16_t j = 0; j < request->columnCount; j++) {
         if (currentRow->columns[j] != NULL) {
-            const char* currentValue = currentRow->columns[j];
-            unsigned long currentLength = currentRow->columnLengths[j];
-            if (this->cast) {
-                node_db::Result::Column::type_t columnType = currentColumn->getType();
-                switch (columnType) {
-                    case node_db::Result::Column::BOOL:
-                        value = v8::Local<v8::Value>::New(currentValue == NULL || currentLength == 0 || currentValue[0] != '0' ? v8::True() : v8::False());
-                        break;
-                    case node_db::Result::Column::INT:
-                        value = v8::String::New(currentValue, currentLength)->ToInteger();
-                        break;
-                    case node_db::Result::Column::NUMBER:
-                        value = v8::String::New(currentValue, currentLength)->ToNumber();
-                        break;
-                    case node_db::Result::Column::TIME:
-                        {
-                            int hour, min, sec;
-                            sscanf(currentValue, "%d:%d:%d", &hour, &min, &sec);
-                            value = v8::Date::New(static_cast<uint64_t>((hour*60*60 + min*60 + sec) * 1000));
-                        }
+            row->Set(request->columns[j].name, request->columns[j].cast(currentRow->columns[j], currentRow->columnLengths[j], currentRow->cells != NULL ? &(currentRow->cells[j]) : NULL, currentRow->arena));
+        }
+    }
+
+    return row;
+}
+
+v8::Local<v8::Object> node_db::Query::lazyRow(execute_request_t* request, row_t* currentRow, lazy_t* lazy, v8::Local<v8::Object> holder) const {
+    v8::Local<v8::Object> row = request->rowTemplate->NewInstance();
+    row->SetPointerInInternalField(0, currentRow);
+    row->SetPointerInInternalField(1, lazy);
+    row->SetInternalField(2, holder);
+    return row;
+}
+
+v8::Handle<v8::Value> node_db::Query::GetLazyColumn(v8::Local<v8::String> property, const v8::AccessorInfo& info) {
+    v8::HandleScope scope;
+
+    v8::Local<v8::Object> row = info.Holder();
+    int index = info.Data()->Int32Value();
+
+    // Cells are decoded on first access, and kept in the row from then on
+    v8::Local<v8::Value> value = row->GetInternalField(Query::lazyFields + index);
+    if (value->IsUndefined()) {
+        row_t* currentRow = static_cast<row_t*>(row->GetPointerFromInternalField(0));
+        lazy_t* lazy = static_cast<lazy_t*>(row->GetPointerFromInternalField(1));
+
+        if (currentRow->columns[index] != NULL) {
+            value = lazy->casts[index](currentRow->columns[index], currentRow->columnLengths[index], currentRow->cells != NULL ? &(currentRow->cells[index]) : NULL, currentRow->arena);
+        } else {
+            value = v8::Local<v8::Value>::New(v8::Null());
+        }
+        row->SetInternalField(Query::lazyFields + index, value);
+    }
+
+    return scope.Close(value);
+}
+
+void node_db::Query::SetLazyColumn(v8::Local<v8::String> property, v8::Local<v8::Value> value, const v8::AccessorInfo& info) {
+    info.Holder()->SetInternalField(Query::lazyFields + info.Data()->Int32Value(), value);
+}
+
+void node_db::Query::releaseLazyRows(v8::Persistent<v8::Value> holder, void* data) {
+    static_cast<lazy_t*>(data)->arena->release();
+    holder.Dispose();
+    holder.Clear();
+}
+
+template<node_db::Result::Column::type_t T>
+v8::Local<v8::Value> node_db::Query::castValue(const char* currentValue, unsigned long currentLength, const cell_t* cell, Arena* arena) {
+    if (cell != NULL && cell->parsed) {
+        return Query::externalString(currentValue, currentLength, arena);
+    }
+    return v8::String::New(currentValue, currentLength);
+}
+
+namespace node_db {
+template<>
+v8::Local<v8::Value> Query::castValue<Result::Column::BOOL>(const char* currentValue, unsigned long currentLength, const cell_t* cell, Arena* arena) {
+    return v8::Local<v8::Value>::New(currentValue == NULL || currentLength == 0 || currentValue[0] != '0' ? v8::True() : v8::False());
+}
+
+template<>
+v8::Local<v8::Value> Query::castValue<Result::Column::INT>(const char* currentValue, unsigned long currentLength, const cell_t* cell, Arena* arena) {
+    if (cell != NULL && cell->parsed) {
+        if (cell->integer >= std::numeric_limits<int32_t>::min() && cell->integer <= std::numeric_limits<int32_t>::max()) {
+            return v8::Integer::New(static_cast<int32_t>(cell->integer));
+        }
+        return v8::Number::New(static_cast<double>(cell->integer));
+    }
+    return v8::String::New(currentValue, currentLength)->ToInteger();
+}
+
+template<>
+v8::Local<v8::Value> Query::castValue<Result::Column::BIGINT>(const char* currentValue, unsigned long currentLength, const cell_t* cell, Arena* arena) {
+    if (cell != NULL && cell->parsed) {
+        return Query::castValue<Result::Column::INT>(currentValue, currentLength, cell, arena);
+    }
+    return v8::String::New(currentValue, currentLength);
+}
+
+template<>
+v8::Local<v8::Value> Query::castValue<Result::Column::NUMBER>(const char* currentValue, unsigned long currentLength, const cell_t* cell, Arena* arena) {
+    if (cell != NULL && cell->parsed) {
+        return v8::Number::New(cell->number);
+    }
+    return v8::String::New(currentValue, currentLength)->ToNumber();
+}
+
+template<>
+v8::Local<v8::Value> Query::castValue<Result::Column::TIME>(const char* currentValue, unsigned long currentLength, const cell_t* cell, Arena* arena) {
+    if (cell != NULL && cell->parsed) {
+        return v8::Date::New(cell->number);
+    }
+    return v8::String::New(currentValue, currentLength);
+}
+
+template<>
+v8::Local<v8::Value> Query::castValue<Result::Column::DATE>(const char* currentValue, unsigned long currentLength, const cell_t* cell, Arena* arena) {
+    if (cell != NULL && cell->parsed) {
+        return v8::Date::New(cell->number);
+    }
+    return v8::String::New(currentValue, currentLength);
+}
+
+template<>
+v8::Local<v8::Value> Query::castValue<Result::Column::DATETIME>(const char* currentValue, unsigned long currentLength, const cell_t* cell, Arena* arena) {
+    if (cell != NULL && cell->parsed) {
+        return v8::Date::New(cell->number);
+    }
+    return v8::String::New(currentValue, currentLength);
+}
+
+template<>
+v8::Local<v8::Value> Query::castValue<Result::Column::SET>(const char* currentValue, unsigned long currentLength, const cell_t* cell, Arena* arena) {
+    const char* end = currentValue + currentLength;
+    const char* current;
+    const char* separator;
+
+    // First pass counts the items so the array is allocated at its final size
+    uint32_t count = 0;
+    for (current = currentValue; current < end; current = separator + 1) {
+        separator = static_cast<const char*>(memchr(current, ',', end - current));
+        if (separator == NULL) {
+            separator = end;
+        }
+        if (separator > current) {
+            count++;
+        }
+    }
+
+    v8::Local<v8::Array> values = v8::Array::New(count);
+    uint32_t index = 0;
+    for (current = currentValue; current < end; current = separator + 1) {
+        separator = static_cast<const char*>(memchr(current, ',', end - current));
+        if (separator == NULL) {
+            separator = end;
+        }
+        if (separator > current) {
+            values->Set(index++, v8::String::New(current, separator - current));
+        }
+    }
+    return values;
+}
+}  // namespace node_db
+
+v8::Local<v8::Value> node_db::Query::castBuffer(const char* currentValue, unsigned long currentLength, const cell_t* cell, Arena* arena) {
+    if (!Query::isShareable(currentLength, arena)) {
+        return v8::Local<v8::Value>::New(node::Buffer::New(const_cast<char*>(currentValue), currentLength)->handle_);
+    }
+
+    // The Buffer keeps the arena holding its bytes alive until it is collected
+    arena->share();
+    return v8::Local<v8::Value>::New(node::Buffer::New(const_cast<char*>(currentValue), currentLength, Query::releaseBuffer, arena)->handle_);
+}
+
+void node_db::Query::releaseBuffer(char* data, void* hint) {
+    static_cast<node_db::Arena*>(hint)->release();
+}
+
+node_db::Query::ExternalString::ExternalString(const char* buffer, size_t length, node_db::Arena* arena)
+    :buffer(buffer), bufferLength(length), arena(arena) {
+    if (this->arena != NULL) {
+        this->arena->share();
+    } else {
+        v8::V8::AdjustAmountOfExternalAllocatedMemory(this->bufferLength);
+    }
+}
+
+node_db::Query::ExternalString::~ExternalString() {
+    if (this->arena != NULL) {
+        this->arena->release();
+    } else {
+        v8::V8::AdjustAmountOfExternalAllocatedMemory(-static_cast<intptr_t>(this->bufferLength));
+        free(const_cast<char*>(this->buffer));
+    }
+}
+
+const char* node_db::Query::ExternalString::data() const {
+    return this->buffer;
+}
+
+size_t node_db::Query::ExternalString::length() const {
+    return this->bufferLength;
+}
+
+v8::Local<v8::Value> node_db::Query::externalString(const char* currentValue, unsigned long currentLength, Arena* arena) {
+    // Arena memory is shared with the string as is, other values are copied
+    // once since they go away with the result or would pin a larger arena
+    if (!Query::isShareable(currentLength, arena)) {
+        arena = NULL;
+        char* copy = static_cast<char*>(malloc(currentLength));
+        if (copy == NULL) {
+            return v8::String::New(currentValue, currentLength);
+        }
+        memcpy(copy, currentValue, currentLength);
+        currentValue = copy;
+    }
+    return v8::String::NewExternal(new ExternalString(currentValue, currentLength, arena));
+}
+
+bool node_db::Query::isShareable(unsigned long currentLength, const Arena* arena) {
+    // A zero-copy view keeps its whole arena alive, which is only worth it for
+    // large values that are also a sizeable part of that arena
+    return (arena != NULL && currentLength >= Query::shareThreshold && currentLength >= arena->size() / Query::shareFraction);
+}
+
+bool node_db::Query::isAscii(const char* currentValue, unsigned long currentLength) {
+    const char* current = currentValue;
+    const char* end = currentValue + currentLength;
+
+#ifdef __SSE2__
+    for (; end - current >= 16; current += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(current))) != 0) {
+            return false;
+        }
+    }
+#else
+    for (; end - current >= 8; current += 8) {
+        uint64_t word;
+        memcpy(&word, current, sizeof(word));
+        if ((word & 0x8080808080808080ULL) != 0) {
+            return false;
+        }
+    }
+#endif
+
+    for (; current < end; current++) {
+        if (static_cast<unsigned char>(*current) & 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool node_db::Query::parseText(const char* currentValue, unsigned long currentLength, cell_t* cell, zones_t* zones) {
+    // Only large ASCII values are worth sharing with V8 as external strings
+    return (currentLength >= Query::externalStringThreshold && Query::isAscii(currentValue, currentLength));
+}
+
+bool node_db::Query::parseInteger(const char* currentValue, unsigned long currentLength, cell_t* cell, zones_t* zones) {
+    const char* current = currentValue;
+    const char* end = currentValue + currentLength;
+    bool negative = false;
+
+    if (current < end && (*current == '-' || *current == '+')) {
+        negative = (*current == '-');
+        current++;
+    }
+    // Up to 18 digits always fit in an int64_t, longer values are left to V8
+    if (current == end || end - current > 18) {
+        return false;
+    }
+
+    uint64_t value = 0;
+    for (; current < end; current++) {
+        unsigned int digit = static_cast<unsigned char>(*current) - '0';
+        if (digit > 9) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+
+    // A negative zero has to stay a double, which V8 takes care of
+    if (negative && value == 0) {
+        return false;
+    }
+
+    cell->integer = negative ? -static_cast<int64_t>(value) : static_cast<int64_t>(value);
+    return true;
+}
+
+bool node_db::Query::parseBigint(const char* currentValue, unsigned long currentLength, cell_t* cell, zones_t* zones) {
+    // Only values a double holds exactly become numbers, others stay strings
+    static const int64_t maxSafe = 9007199254740992LL;
+    if (!Query::parseInteger(currentValue, currentLength, cell, zones)) {
+        return false;
+    }
+    return (cell->integer >= -maxSafe && cell->integer <= maxSafe);
+}
+
+bool node_db::Query::parseNumber(const char* currentValue, unsigned long currentLength, cell_t* cell, zones_t* zones) {
+    static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* current = currentValue;
+    const char* end = currentValue + currentLength;
+    bool negative = false;
+
+    if (current < end && (*current == '-' || *current == '+')) {
+        negative = (*current == '-');
+        current++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0, significant = 0, exponent = 0;
+    for (; current < end && *current >= '0' && *current <= '9'; current++, digits++) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (*current - '0');
+            if (mantissa > 0) {
+                significant++;
+            }
+        } else {
+            exponent++;
+        }
+    }
+    if (current < end && *current == '.') {
+        for (current++; current < end && *current >= '0' && *current <= '9'; current++, digits++) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (*current - '0');
+                if (mantissa > 0) {
+                    significant++;
+                }
+                exponent--;
+            }
+        }
+    }
+    if (digits == 0) {
+        return false;
+    }
+
+    if (current < end && (*current == 'e' || *current == 'E')) {
+        bool negativeExponent = false;
+        int value = 0;
+        const char* start;
+
+        current++;
+        if (current < end && (*current == '-' || *current == '+')) {
+            negativeExponent = (*current == '-');
+            current++;
+        }
+        for (start = current; current < end && *current >= '0' && *current <= '9'; current++) {
+            if (value < 100000) {
+                value = value * 10 + (*current - '0');
+            }
+        }
+        if (current == start) {
+            return false;
+        }
+        exponent += negativeExponent ? -value : value;
+    }
+    if (current != end) {
+        return false;
+    }
+
+    // Exact when both the mantissa and the power of ten are representable as
+    // doubles, since a single IEEE multiplication or division rounds correctly
+    if (significant <= 15 && exponent >= -22 && exponent <= 22) {
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / powersOfTen[-exponent] : value * powersOfTen[exponent];
+        cell->number = negative ? -value : value;
+        return true;
+    }
+
+    char buffer[64];
+    if (currentLength >= sizeof(buffer)) {
+        return false;
+    }
+    memcpy(buffer, currentValue, currentLength);
+    buffer[currentLength] = '\0';
+
+    char* parsedEnd = NULL;
+    cell->number = strtod(buffer, &parsedEnd);
+    return (parsedEnd == buffer + currentLength);
+}
+
+static bool parseDigits(const char** current, const char* end, int count, int* value) {
+    if (end - *current < count) {
+        return false;
+    }
+
+    *value = 0;
+    for (int i = 0; i < count; i++, (*current)++) {
+        unsigned int digit = static_cast<unsigned char>(**current) - '0';
+        if (digit > 9) {
+            return false;
+        }
+        *value = *value * 10 + digit;
+    }
+    return true;
+}
+
+static bool parseSeconds(const char** current, const char* end, int* sec, int* msec) {
+    if (*current == end || **current != ':') {
+        return false;
+    }
+    (*current)++;
+    if (!parseDigits(current, end, 2, sec)) {
+        return false;
+    }
+
+    // Fractional seconds are truncated to milliseconds
+    *msec = 0;
+    if (*current < end && **current == '.') {
+        int digits = 0;
+        for ((*current)++; *current < end && **current >= '0' && **current <= '9'; (*current)++, digits++) {
+            if (digits < 3) {
+                *msec = *msec * 10 + (**current - '0');
+            }
+        }
+        if (digits == 0) {
+            return false;
+        }
+        for (; digits < 3; digits++) {
+            *msec *= 10;
+        }
+    }
+    return true;
+}
+
+bool node_db::Query::parseTime(const char* currentValue, unsigned long currentLength, cell_t* cell, zones_t* zones) {
+    const char* current = currentValue;
+    const char* end = currentValue + currentLength;
+    int hour = 0, min = 0, sec = 0, msec = 0;
+
+    // Hours go up to 838 in MySQL, negative durations are left as strings
+    for (; current < end && *current >= '0' && *current <= '9' && hour < 100000; current++) {
+        hour = hour * 10 + (*current - '0');
+    }
+    if (current == currentValue || current == end || *current != ':') {
+        return false;
+    }
+    current++;
+    if (!parseDigits(&current, end, 2, &min) || !parseSeconds(&current, end, &sec, &msec) || current != end) {
+        return false;
+    }
+
+    cell->number = static_cast<double>((static_cast<int64_t>(hour) * 3600 + min * 60 + sec) * 1000 + msec);
+    return true;
+}
+
+bool node_db::Query::parseDate(const char* currentValue, unsigned long currentLength, cell_t* cell, zones_t* zones) {
+    return Query::parseTimestamp(currentValue, currentLength, false, zones, &(cell->number));
+}
+
+bool node_db::Query::parseDatetime(const char* currentValue, unsigned long currentLength, cell_t* cell, zones_t* zones) {
+    return Query::parseTimestamp(currentValue, currentLength, true, zones, &(cell->number));
+}
+
+bool node_db::Query::parseUtcDate(const char* currentValue, unsigned long currentLength, cell_t* cell, zones_t* zones) {
+    return Query::parseTimestamp(currentValue, currentLength, false, NULL, &(cell->number));
+}
+
+bool node_db::Query::parseUtcDatetime(const char* currentValue, unsigned long currentLength, cell_t* cell, zones_t* zones) {
+    return Query::parseTimestamp(currentValue, currentLength, true, NULL, &(cell->number));
+}
+
+bool node_db::Query::parseTimestamp(const char* currentValue, unsigned long currentLength, bool hasTime, zones_t* zones, double* timestamp) {
+    const char* current = currentValue;
+    const char* end = currentValue + currentLength;
+    int year = 0, month = 0, day = 0, hour = 0, min = 0, sec = 0, msec = 0;
+
+    if (!parseDigits(&current, end, 4, &year)
+        || current == end || *current++ != '-' || !parseDigits(&current, end, 2, &month)
+        || current == end || *current++ != '-' || !parseDigits(&current, end, 2, &day)) {
+        return false;
+    }
+    if (hasTime) {
+        if (current == end || *current++ != ' ' || !parseDigits(&current, end, 2, &hour)
+            || current == end || *current++ != ':' || !parseDigits(&current, end, 2, &min)
+            || !parseSeconds(&current, end, &sec, &msec)) {
+            return false;
+        }
+    }
+
+    // Zero dates such as 0000-00-00 are not valid dates and stay strings
+    if (current != end || month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || min > 59 || sec > 59) {
+        return false;
+    }
+
+    int64_t seconds = Query::daysFromCivil(year, month, day) * 86400 + hour * 3600 + min * 60 + sec;
+    // Without a zone table the value is read as UTC
+    if (zones != NULL) {
+        seconds -= Query::zoneOffset(zones, year, seconds - Query::zoneOffset(zones, year, seconds));
+    }
+
+    *timestamp = static_cast<double>(seconds) * 1000 + msec;
+    return true;
+}
+
+int64_t node_db::Query::daysFromCivil(int year, int month, int day) {
+    // Days since 1970-01-01 in the proleptic Gregorian calendar, see
+    // http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+    year -= (month <= 2 ? 1 : 0);
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yearOfEra = year - era * 400;
+    int64_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+int node_db::Query::localOffset(int64_t timestamp) {
+    struct tm timeinfo;
+    time_t rawtime = static_cast<time_t>(timestamp);
+    if (!localtime_r(&rawtime, &timeinfo)) {
+        return 0;
+    }
+
+    int64_t local = Query::daysFromCivil(timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday) * 86400
+        + timeinfo.tm_hour * 3600 + timeinfo.tm_min * 60 + timeinfo.tm_sec;
+    return static_cast<int>(local - timestamp);
+}
+
+int node_db::Query::zoneOffset(zones_t* zones, int year, int64_t timestamp) {
+    // Each request keeps its own copy of the years it has seen, so parsing
+    // only takes the shared lock once per year and request
+    zones_t::iterator found = zones->find(year);
+    if (found == zones->end()) {
+        found = zones->insert(std::make_pair(year, Query::zoneTransitions(year))).first;
+    }
+
+    int offset = found->second[0].offset;
+    for (size_t i = 1; i < found->second.size() && found->second[i].start <= timestamp; i++) {
+        offset = found->second[i].offset;
+    }
+
+    return offset;
+}
+
+std::vector<node_db::Query::zone_t> node_db::Query::zoneTransitions(int year) {
+    pthread_mutex_lock(&Query::zonesLock);
+    zones_t::iterator found = Query::zones.find(year);
+    if (found != Query::zones.end()) {
+        std::vector<zone_t> transitions = found->second;
+        pthread_mutex_unlock(&Query::zonesLock);
+        return transitions;
+    }
+    pthread_mutex_unlock(&Query::zonesLock);
+
+    // Offsets change a handful of times a year at most: sample the zone
+    // once a day (with a day of margin on each side, so any local time
+    // of the year resolves here) and bisect every change to the second
+    std::vector<zone_t> transitions;
+    int64_t first = Query::daysFromCivil(year, 1, 1) * 86400 - 86400;
+    int64_t last = Query::daysFromCivil(year + 1, 1, 1) * 86400 + 86400;
+    zone_t zone = { first, Query::localOffset(first) };
+    transitions.push_back(zone);
+
+    for (int64_t day = first + 86400; day <= last; day += 86400) {
+        int offset = Query::localOffset(day);
+        if (offset != transitions.back().offset) {
+            int64_t low = day - 86400, high = day;
+            while (high - low > 1) {
+                int64_t middle = low + (high - low) / 2;
+                if (Query::localOffset(middle) == transitions.back().offset) {
+                    low = middle;
+                } else {
+                    high = middle;
+                }
+            }
+            zone.start = high;
+            zone.offset = offset;
+            transitions.push_back(zone);
+        }
+    }
+
+    // Years far from the ones being read are dropped first once the shared
+    // table is full
+    pthread_mutex_lock(&Query::zonesLock);
+    if (Query::zones.size() >= Query::zoneCacheSize) {
+        zones_t::iterator farthest = (year - Query::zones.begin()->first > Query::zones.rbegin()->first - year) ? Query::zones.begin() : --Query::zones.end();
+        Query::zones.erase(farthest);
+    }
+    Query::zones.insert(std::make_pair(year, transitions));
+    pthread_mutex_unlock(&Query::zonesLock);
+
+    return transitions;
+}
+
+node_db::Query::cast_t node_db::Query::caster(const node_db::Result::Column::info_t& column) const {
+    if (!this->cast) {
+        return Query::castValue<node_db::Result::Column::STRING>;
+    }
+
+    switch (column.type) {
+        case node_db::Result::Column::BOOL:
+            return Query::castValue<node_db::Result::Column::BOOL>;
+        case node_db::Result::Column::INT:
+            return Query::castValue<node_db::Result::Column::INT>;
+        case node_db::Result::Column::BIGINT:
+            if (this->bigintAsNumber) {
+                return Query::castValue<node_db::Result::Column::INT>;
+            }
+            return Query::castValue<node_db::Result::Column::BIGINT>;
+        case node_db::Result::Column::NUMBER:
+            return Query::castValue<node_db::Result::Column::NUMBER>;
+        case node_db::Result::Column::TIME:
+            return Query::castValue<node_db::Result::Column::TIME>;
+        case node_db::Result::Column::DATE:
+            return Query::castValue<node_db::Result::Column::DATE>;
+        case node_db::Result::Column::DATETIME:
+            return Query::castValue<node_db::Result::Column::DATETIME>;
+        case node_db::Result::Column::SET:
+            return Query::castValue<node_db::Result::Column::SET>;
+        case node_db::Result::Column::TEXT:
+            if (this->bufferText || column.binary) {
+                return Query::castBuffer;
+            }
+            return Query::castValue<node_db::Result::Column::TEXT>;
+        default:
+            return Query::castValue<node_db::Result::Column::STRING>;
+    }
+}
+
+v8::Local<v8::Object> node_db::Query::columnarRows(execute_request_t* request, const std::vector<row_t*>& rows) const {
+    this->prepareColumns(request);
+
+    v8::Local<v8::Object> columns = v8::Object::New();
+    v8::Local<v8::Object> global = v8::Context::GetCurrent()->Global();
+    v8::Local<v8::Value> length = v8::Integer::NewFromUnsigned(rows.size());
+    size_t totalRows = rows.size();
+
+    for (uint16_t j = 0; j < request->columnCount; j++) {
+        node_db::Result::Column::type_t columnType = request->columns[j].type;
+        v8::Local<v8::Value> values;
+
+        // Numeric columns without NULLs are written straight into a typed array
+        // backing store. Any cell that does not fit falls back to a regular array
+        const char* typedArray = NULL;
+        if (this->cast) {
+            switch (columnType) {
+                case node_db::Result::Column::INT:
+                    typedArray = "Int32Array";
+                    break;
+                case node_db::Result::Column::NUMBER:
+                case node_db::Result::Column::BIGINT:
+                    typedArray = "Float64Array";
+                    break;
+                case node_db::Result::Column::BOOL:
+                    typedArray = "Uint8Array";
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        if (typedArray != NULL) {
+            v8::Local<v8::Value> constructor = global->Get(v8::String::NewSymbol(typedArray));
+            if (constructor->IsFunction()) {
+                v8::Local<v8::Object> array = v8::Local<v8::Function>::Cast(constructor)->NewInstance(1, &length);
+                void* data = array->GetIndexedPropertiesExternalArrayData();
+                bool filled = (data != NULL || totalRows == 0);
+
+                for (size_t i = 0; filled && i < totalRows; i++) {
+                    const char* currentValue = rows[i]->columns[j];
+                    unsigned long currentLength = rows[i]->columnLengths[j];
+                    if (currentValue == NULL || currentLength == 0) {
+                        filled = false;
                         break;
-                    case node_db::Result::Column::DATE:
-                    case node_db::Result::Column::DATETIME:
-                        // Code largely inspired from https://github.com/Sannis/node-mysql-libmysqlclient
-                        try {
-                            int day = 0, month = 0, year = 0, hour = 0, min = 0, sec = 0;
-                            time_t rawtime;
-                            struct tm timeinfo;
-
-                            if (columnType == node_db::Result::Column::DATETIME) {
-                                sscanf(currentValue, "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &min, &sec);
+                    }
+
+                    const cell_t* cell = (rows[i]->cells != NULL ? &(rows[i]->cells[j]) : NULL);
+                    switch (columnType) {
+                        case node_db::Result::Column::INT:
+                            if (cell == NULL || !cell->parsed || cell->integer < std::numeric_limits<int32_t>::min() || cell->integer > std::numeric_limits<int32_t>::max()) {
+                                filled = false;
                             } else {
-                                sscanf(currentValue, "%d-%d-%d", &year, &month, &day);
+                                static_cast<int32_t*>(data)[i] = static_cast<int32_t>(cell->integer);
                             }
-
-                            time(&rawtime);
-                            if (!localtime_r(&rawtime, &timeinfo)) {
-                                throw node_db::Exception("Can't get local time");
+                            break;
+                        case node_db::Result::Column::NUMBER:
+                            if (cell == NULL || !cell->parsed) {
+                                filled = false;
+                            } else {
+                                static_cast<double*>(data)[i] = cell->number;
                             }
-
-                            if (!Query::gmtDeltaLoaded) {
-                                int localHour, gmtHour, localMin, gmtMin;
-
-                                localHour = timeinfo.tm_hour - (timeinfo.tm_isdst > 0 ? 1 : 0);
-                                localMin = timeinfo.tm_min;
-
-                                if (!gmtime_r(&rawtime, &timeinfo)) {
-                                    throw node_db::Exception("Can't get GMT time");
-                                }
-                                gmtHour = timeinfo.tm_hour;
-                                gmtMin = timeinfo.tm_min;
-
-                                Query::gmtDelta = ((localHour - gmtHour) * 60 + (localMin - gmtMin)) * 60;
-                                if (Query::gmtDelta <= -(12 * 60 * 60)) {
-                                    Query::gmtDelta += 24 * 60 * 60;
-                                } else if (Query::gmtDelta > (12 * 60 * 60)) {
-                                    Query::gmtDelta -= 24 * 60 * 60;
-                                }
-                                Query::gmtDeltaLoaded = true;
+                            break;
+                        case node_db::Result::Column::BIGINT:
+                            if (cell == NULL || !cell->parsed) {
+                                filled = false;
+                            } else {
+                                static_cast<double*>(data)[i] = static_cast<double>(cell->integer);
                             }
+                            break;
+                        default:
+                            static_cast<uint8_t*>(data)[i] = (currentValue[0] != '0' ? 1 : 0);
+                            break;
+                    }
+                }
 
-                            timeinfo.tm_year = year - 1900;
-                            timeinfo.tm_mon = month - 1;
-                            timeinfo.tm_mday = day;
-                            timeinfo.tm_hour = hour;
-                            timeinfo.tm_min = min;
-                            timeinfo.tm_sec = sec;
-
-                            value = v8::Date::New(static_cast<double>(mktime(&timeinfo) + Query::gmtDelta) * 1000);
-                        } catch(const node_db::Exception&) {
-                            value = v8::String::New(currentValue, currentLength);
-                        }
-                        break;
-                    case node_db::Result::Column::SET:
-                        {
-                            v8::Local<v8::Array> values = v8::Array::New();
-                            std::istringstream stream(currentValue);
-                            std::string item;
-                            uint64_t index = 0;
-                            std::ostringstream reusableStream;
-                            while (std::getline(stream, item, ',')) {
-                                if (!item.empty()) {
-                                    values->Set(v8StringFromUInt64(index++, reusableStream), v8::String::New(item.c_str()));
-                                }
-                            }
-                            value = values;
-                        }
-                        break;
-                    case node_db::Result::Column::TEXT:
-                        if (this->bufferText || currentColumn->isBinary()) {
-                            value = v8::Local<v8::Value>::New(node::Buffer::New(v8::String::New(currentValue, currentLength)));
-                        } else {
-                            value = v8::String::New(currentValue, currentLength);
-                        }
-                        break;
-                    default:
-                        value = v8::String::New(currentValue, currentLength);
-                        break;
+                if (filled) {
+                    values = array;
                 }
-            } else {
-                value = v8::String::New(currentValue, currentLength);
             }
-        } else {
-            value = v8::Local<v8::Value>::New(v8::Null());
         }
-        row->Set(v8::String::New(currentColumn->getName().c_str()), value);
+
+        if (values.IsEmpty()) {
+            v8::Local<v8::Array> array = v8::Array::New(totalRows);
+            for (size_t i = 0; i < totalRows; i++) {
+                if (rows[i]->columns[j] != NULL) {
+                    array->Set(i, request->columns[j].cast(rows[i]->columns[j], rows[i]->columnLengths[j], rows[i]->cells != NULL ? &(rows[i]->cells[j]) : NULL, rows[i]->arena));
+                } else {
+                    array->Set(i, v8::Null());
+                }
+            }
+            values = array;
+        }
+
+        columns->Set(request->columns[j].name, values);
     }
 
-    return row;
+    return columns;
 }
 
 std::vector<std::string::size_type> node_db::Query::placeholders(std::string* parsed) const throw(node_db::Exception&) {
@@ -1366,16 +2697,19 @@ std::vector<std::string::size_type> node_db::Query::placeholders(std::string* pa
     std::vector<std::string::size_type> positions;
     char quote = 0;
     bool escaped = false;
-    uint32_t delta = 0;
+    std::string::size_type start = 0;
 
-    *parsed = query;
+    // Unescaped segments are appended as they are found, so dropping the
+    // backslash of an escaped placeholder never shifts the rest of the query
+    parsed->clear();
+    parsed->reserve(query.length());
 
     for (std::string::size_type i = 0, limiti = query.length(); i < limiti; i++) {
         char currentChar = query[i];
         if (escaped) {
             if (currentChar == '?') {
-                parsed->replace(i - 1 - delta, 1, "");
-                delta++;
+                parsed->append(query, start, i - 1 - start);
+                start = i;
             }
             escaped = false;
         } else if (currentChar == '\\') {
@@ -1385,10 +2719,12 @@ std::vector<std::string::size_type> node_db::Query::placeholders(std::string* pa
         } else if (!quote && (currentChar == this->connection->quoteString)) {
             quote = currentChar;
         } else if (!quote && currentChar == '?') {
-            positions.push_back(i - delta);
+            positions.push_back(parsed->length() + (i - start));
         }
     }
 
+    parsed->append(query, start, std::string::npos);
+
     if (positions.size() != this->values.size()) {
         throw node_db::Exception("Wrong number of values to escape");
     }
@@ -1396,50 +2732,121 @@ std::vector<std::string::size_type> node_db::Query::placeholders(std::string* pa
     return positions;
 }
 
+node_db::Query::template_ptr_t node_db::Query::parseTemplate() const throw(node_db::Exception&) {
+    std::string query = this->sql.str();
+    char quoteString = this->connection->quoteString;
+
+    // Parsed templates are kept per quote character, most recently used first.
+    // Entries are shared read-only, so a hit only copies a pointer
+    if (query.length() <= Query::templateMaxLength) {
+        template_ptr_t cached;
+
+        pthread_mutex_lock(&Query::templatesLock);
+        templates_t& templates = Query::templates[quoteString];
+        templates_t::iterator found = templates.find(query);
+        if (found != templates.end()) {
+            Query::templatesUsage.splice(Query::templatesUsage.begin(), Query::templatesUsage, found->second.usage);
+            cached = found->second.value;
+        }
+        pthread_mutex_unlock(&Query::templatesLock);
+
+        if (cached) {
+            if (cached->positions.size() != this->values.size()) {
+                throw node_db::Exception("Wrong number of values to escape");
+            }
+            return cached;
+        }
+    }
+
+    template_t* parsed = new template_t();
+    template_ptr_t result(parsed);
+    parsed->positions = this->placeholders(&(parsed->parsed));
+
+    if (query.length() <= Query::templateMaxLength) {
+        pthread_mutex_lock(&Query::templatesLock);
+        templates_t& templates = Query::templates[quoteString];
+        std::pair<templates_t::iterator, bool> inserted = templates.insert(std::make_pair(query, cached_template_t()));
+        if (inserted.second) {
+            inserted.first->second.value = result;
+            Query::templatesUsage.push_front(std::make_pair(quoteString, &(inserted.first->first)));
+            inserted.first->second.usage = Query::templatesUsage.begin();
+
+            if (Query::templatesUsage.size() > Query::templateCacheSize) {
+                std::pair<char, const std::string*> oldest = Query::templatesUsage.back();
+                Query::templatesUsage.pop_back();
+                templates_t& oldestTemplates = Query::templates[oldest.first];
+                oldestTemplates.erase(oldestTemplates.find(*(oldest.second)));
+            }
+        }
+        pthread_mutex_unlock(&Query::templatesLock);
+    }
+
+    return result;
+}
+
 std::string node_db::Query::parseQuery() const throw(node_db::Exception&) {
-    std::string parsed;
-    std::vector<std::string::size_type> positions = this->placeholders(&parsed);
+    template_ptr_t parsedTemplate = this->parseTemplate();
+    const std::string& parsed = parsedTemplate->parsed;
+    const std::vector<std::string::size_type>& positions = parsedTemplate->positions;
+
+    // Values are rendered straight into the query, which is sized for the
+    // literal text plus a typical short value per placeholder
+    std::string query;
+    query.reserve(parsed.length() + positions.size() * 8);
+
+    std::string::size_type start = 0;
+    for (std::vector<std::string::size_type>::size_type i = 0, limiti = positions.size(); i < limiti; i++) {
+        query.append(parsed, start, positions[i] - start);
+
+        std::string::size_type length = query.length();
+        this->value(&query, this->values[i]);
+        if (query.length() == length) {
+            throw node_db::Exception("Internal error, attempting to replace with zero length value");
+        }
+
+        start = positions[i] + 1;
+    }
+    query.append(parsed, start, std::string::npos);
 
-    uint32_t index = 0, delta = 0;
-    for (std::vector<std::string::size_type>::iterator iterator = positions.begin(), end = positions.end(); iterator != end; ++iterator, index++) {
-        std::string value = this->value(*(this->values[index]));
+    return query;
+}
+
+std::string node_db::Query::parseStatement() const throw(node_db::Exception&) {
+    // Builder values are already written into the SQL, there is nothing to bind
+    if (this->interpolated) {
+        throw node_db::Exception("Values given to select(), insert() or set() can't be used in prepared statements, bind them with ? markers instead");
+    }
 
-	if(!value.length()) {
-		throw node_db::Exception("Internal error, attempting to replace with zero length value");
-	}
+    // The server sees every remaining marker, so escaped ones can't be told apart
+    if (this->sql.str().find("\\?") != std::string::npos) {
+        throw node_db::Exception("Escaped placeholders can't be used in prepared statements");
+    }
 
-        parsed.replace(*iterator + delta, 1, value);
-        delta += (value.length() - 1);
+    for (std::vector<node_db::Value>::const_iterator iterator = this->values.begin(), end = this->values.end(); iterator != end; ++iterator) {
+        if (iterator->getType() == node_db::Value::LIST || iterator->getType() == node_db::Value::RAW) {
+            throw node_db::Exception("Arrays, subqueries, unescaped values and numbers with a precision can't be bound as statement parameters");
+        }
     }
 
-    return parsed;
+    return this->parseTemplate()->parsed;
 }
 
-std::string node_db::Query::value(v8::Local<v8::Value> value, bool inArray, bool escape, int precision) const throw(node_db::Exception&) {
-    std::ostringstream currentStream;
+node_db::Value node_db::Query::toValue(v8::Local<v8::Value> value, bool escape, int precision) throw(node_db::Exception&) {
+    node_db::Value converted;
 
     if (value->IsNull()) {
-        currentStream << "NULL";
+        converted.setNull();
     } else if (value->IsArray()) {
         v8::Local<v8::Array> array = v8::Array::Cast(*value);
-        if (!inArray) {
-            currentStream << '(';
-        }
-        for (uint32_t i = 0, limiti = array->Length(); i < limiti; i++) {
-            v8::Local<v8::Value> child = array->Get(i);
-            if (child->IsArray() && i > 0) {
-                currentStream << "),(";
-            } else if (i > 0) {
-                currentStream << ',';
-            }
+        converted.setList();
 
-            currentStream << this->value(child, true, escape);
-        }
-        if (!inArray) {
-            currentStream << ')';
+        std::vector<node_db::Value>& list = converted.getList();
+        list.reserve(array->Length());
+        for (uint32_t i = 0, limiti = array->Length(); i < limiti; i++) {
+            list.push_back(Query::toValue(array->Get(i), escape));
         }
     } else if (value->IsDate()) {
-        currentStream << this->connection->quoteString << this->fromDate(v8::Date::Cast(*value)->NumberValue()) << this->connection->quoteString;
+        converted.setDate(v8::Date::Cast(*value)->NumberValue());
     } else if (value->IsObject()) {
         v8::Local<v8::Object> object = value->ToObject();
         v8::Handle<v8::String> valueKey = v8::String::New("value");
@@ -1452,7 +2859,7 @@ std::string node_db::Query::value(v8::Local<v8::Value> value, bool inArray, bool
             if (object->Has(precisionKey)) {
                 v8::Local<v8::Value> optionValue = object->Get(precisionKey);
                 if (!optionValue->IsNumber() || optionValue->IntegerValue() < 0) {
-                    throw new node_db::Exception("Specify a number equal or greater than 0 for precision");
+                    throw node_db::Exception("Specify a number equal or greater than 0 for precision");
                 }
                 precision = optionValue->IntegerValue();
             }
@@ -1465,7 +2872,7 @@ std::string node_db::Query::value(v8::Local<v8::Value> value, bool inArray, bool
                 }
                 innerEscape = escapeValue->IsTrue();
             }
-            currentStream << this->value(object->Get(valueKey), false, innerEscape, precision);
+            converted = Query::toValue(object->Get(valueKey), innerEscape, precision);
         } else {
             v8::Handle<v8::String> sqlKey = v8::String::New("sql");
             if (!object->Has(sqlKey) || !object->Get(sqlKey)->IsFunction()) {
@@ -1474,36 +2881,39 @@ std::string node_db::Query::value(v8::Local<v8::Value> value, bool inArray, bool
 
             node_db::Query *query = node::ObjectWrap::Unwrap<node_db::Query>(object);
             assert(query);
+
+            std::string subquery = query->sql.str();
             if (escape) {
-                currentStream << "(";
-            }
-            currentStream << query->sql.str();
-            if (escape) {
-                currentStream << ")";
+                subquery = "(" + subquery + ")";
             }
+            converted.setRaw(subquery.c_str(), subquery.length());
         }
     } else if (value->IsBoolean()) {
-        currentStream << (value->IsTrue() ? '1' : '0');
+        converted.setBool(value->IsTrue());
     } else if (value->IsUint32() || value->IsInt32() || (value->IsNumber() && value->NumberValue() == value->IntegerValue())) {
-        currentStream << value->IntegerValue();
+        converted.setInt(value->IntegerValue());
     } else if (value->IsNumber()) {
         if (precision == -1) {
             v8::String::Utf8Value currentString(value->ToString());
-            currentStream << *currentString;
+            converted.setNumber(value->NumberValue(), *currentString, currentString.length());
         } else {
-            currentStream << std::fixed << std::setprecision(precision) << value->NumberValue();
+            char buffer[64];
+            int length = snprintf(buffer, sizeof(buffer), "%.*f", precision, value->NumberValue());
+            if (length < 0 || length >= static_cast<int>(sizeof(buffer))) {
+                std::ostringstream currentStream;
+                currentStream << std::fixed << std::setprecision(precision) << value->NumberValue();
+                std::string number = currentStream.str();
+                converted.setRaw(number.c_str(), number.length());
+            } else {
+                converted.setRaw(buffer, length);
+            }
         }
     } else if (value->IsString()) {
         v8::String::Utf8Value currentString(value->ToString());
-        std::string string = *currentString;
         if (escape) {
-            try {
-                currentStream << this->connection->quoteString << this->connection->escape(string) << this->connection->quoteString;
-            } catch(node_db::Exception& exception) {
-                currentStream << this->connection->quoteString << string << this->connection->quoteString;
-            }
+            converted.setString(*currentString, currentString.length());
         } else {
-            currentStream << string;
+            converted.setRaw(*currentString, currentString.length());
         }
     } else {
         v8::String::Utf8Value currentString(value->ToString());
@@ -1511,27 +2921,94 @@ std::string node_db::Query::value(v8::Local<v8::Value> value, bool inArray, bool
         throw node_db::Exception("Unknown type for to convert to SQL, converting `" + string + "'");
     }
 
-    return currentStream.str();
+    return converted;
 }
 
-std::string node_db::Query::fromDate(const double timeStamp) const throw(node_db::Exception&) {
-    char* buffer = new char[20];
-    if (buffer == NULL) {
-        throw node_db::Exception("Can\'t create buffer to write parsed date");
-    }
+std::string node_db::Query::value(v8::Local<v8::Value> value, bool inArray, bool escape, int precision) const throw(node_db::Exception&) {
+    std::string output;
+    this->value(&output, Query::toValue(value, escape, precision), inArray);
+    return output;
+}
+
+void node_db::Query::value(std::string* output, const node_db::Value& value, bool inArray) const throw(node_db::Exception&) {
+    switch (value.getType()) {
+        case node_db::Value::NONE:
+            output->append("NULL", 4);
+            break;
+        case node_db::Value::LIST: {
+            const std::vector<node_db::Value>& list = value.getList();
+            if (!inArray) {
+                output->push_back('(');
+            }
+            for (std::vector<node_db::Value>::size_type i = 0, limiti = list.size(); i < limiti; i++) {
+                if (list[i].getType() == node_db::Value::LIST && i > 0) {
+                    output->append("),(", 3);
+                } else if (i > 0) {
+                    output->push_back(',');
+                }
 
+                this->value(output, list[i], true);
+            }
+            if (!inArray) {
+                output->push_back(')');
+            }
+            break;
+        }
+        case node_db::Value::DATE:
+            output->push_back(this->connection->quoteString);
+            this->fromDate(output, value.getDate());
+            output->push_back(this->connection->quoteString);
+            break;
+        case node_db::Value::BOOL:
+            output->push_back(value.getBool() ? '1' : '0');
+            break;
+        case node_db::Value::INT: {
+            char buffer[24];
+            int length = snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(value.getInt()));
+            output->append(buffer, length);
+            break;
+        }
+        case node_db::Value::NUMBER:
+            if (!value.getString().empty()) {
+                output->append(value.getString());
+            } else {
+                char buffer[32];
+                int length = snprintf(buffer, sizeof(buffer), "%.17g", value.getNumber());
+                output->append(buffer, length);
+            }
+            break;
+        case node_db::Value::STRING: {
+            const std::string& string = value.getString();
+            std::string::size_type start = output->length();
+            output->push_back(this->connection->quoteString);
+            try {
+                this->connection->appendEscaped(output, string);
+            } catch(node_db::Exception& exception) {
+                output->resize(start + 1);
+                output->append(string);
+            }
+            output->push_back(this->connection->quoteString);
+            break;
+        }
+        case node_db::Value::RAW:
+            output->append(value.getString());
+            break;
+    }
+}
 
+void node_db::Query::fromDate(std::string* output, const double timeStamp) const throw(node_db::Exception&) {
     struct tm timeinfo;
     time_t rawtime = (time_t) (timeStamp / 1000);
-    if (!localtime_r(&rawtime, &timeinfo)) {
+    if (this->utc) {
+        if (!gmtime_r(&rawtime, &timeinfo)) {
+            throw node_db::Exception("Can't get GMT time");
+        }
+    } else if (!localtime_r(&rawtime, &timeinfo)) {
         throw node_db::Exception("Can't get local time");
     }
 
-    strftime(buffer, 20, "%Y-%m-%d %H:%M:%S", &timeinfo);
-
-    std::string date(buffer);
-    delete [] buffer;
-
-    return date;
+    char buffer[20];
+    size_t length = strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &timeinfo);
+    output->append(buffer, length);
 }
 
@@ -3,33 +3,93 @@
 #define QUERY_H_
 
 #include <v8.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
 #include <node.h>
 #include <node_buffer.h>
 #include <node_version.h>
 #include <algorithm>
 #include <cctype>
+#include <deque>
 #include <iomanip>
+#include <limits>
+#include <list>
+#include <map>
 #include <string>
 #include <sstream>
 #include <vector>
+#include <tr1/memory>
 #include "./node_defs.h"
+#include "./arena.h"
 #include "./connection.h"
 #include "./events.h"
 #include "./exception.h"
 #include "./result.h"
+#include "./value.h"
 
 namespace node_db {
+class Cursor;
+
 class Query : public EventEmitter {
+    friend class Cursor;
+
     public:
         static void Init(v8::Handle<v8::Object> target, v8::Persistent<v8::FunctionTemplate> constructorTemplate);
         void setConnection(Connection* connection);
+        void setLimits(uint32_t maxRows, uint32_t maxResultBytes);
         v8::Handle<v8::Value> set(const v8::Arguments& args);
 
     protected:
+        struct cell_t {
+            union {
+                int64_t integer;
+                double number;
+            };
+            bool parsed;
+        };
         struct row_t {
             char** columns;
             unsigned long* columnLengths;
+            cell_t* cells;
+            Arena* arena;
+        };
+        class ExternalString : public v8::String::ExternalAsciiStringResource {
+            public:
+                ExternalString(const char* buffer, size_t length, Arena* arena);
+                ~ExternalString();
+                const char* data() const;
+                size_t length() const;
+
+            protected:
+                const char* buffer;
+                size_t bufferLength;
+                Arena* arena;
+        };
+        struct zone_t {
+            int64_t start;
+            int offset;
+        };
+        typedef std::map< int, std::vector<zone_t> > zones_t;
+        typedef bool (*parse_t)(const char* value, unsigned long length, cell_t* cell, zones_t* zones);
+        typedef v8::Local<v8::Value> (*cast_t)(const char* value, unsigned long length, const cell_t* cell, Arena* arena);
+        struct column_t {
+            v8::Persistent<v8::String> name;
+            Result::Column::type_t type;
+            cast_t cast;
+        };
+        struct lazy_t {
+            Arena* arena;
+            cast_t* casts;
+        };
+        struct batch_t {
+            Arena* arena;
+            std::vector<row_t*>* rows;
+            uint64_t bytes;
+            bool last;
         };
         struct execute_request_t {
             v8::Persistent<v8::Object> context;
@@ -37,15 +97,60 @@ class Query : public EventEmitter {
             Result* result;
             std::string* error;
             uint16_t columnCount;
+            column_t* columns;
+            parse_t* parsers;
+            v8::Persistent<v8::ObjectTemplate> rowTemplate;
             bool buffered;
+            Arena* arena;
             std::vector<row_t*>* rows;
+            uint64_t index;
+            uv_async_t* stream;
+            pthread_mutex_t batchesLock;
+            pthread_cond_t batchesCondition;
+            std::deque<batch_t*>* batches;
+            uint64_t fetchedRows;
+            uint64_t fetchedBytes;
+            uint64_t queuedRows;
+            uint64_t queuedBytes;
+            uint64_t highWaterMark;
+            uint64_t highWaterBytes;
+            uint32_t pauseTimeout;
+            bool finished;
+            bool draining;
+            zones_t zones;
         };
+        static const size_t streamWindow = 4;
+        static const unsigned long externalStringThreshold = 1024;
+        static const unsigned long shareThreshold = 4096;
+        static const size_t shareFraction = 8;
+        static const int lazyFields = 3;
+        static const size_t templateCacheSize = 1024;
+        static const std::string::size_type templateMaxLength = 4096;
+        static const size_t zoneCacheSize = 64;
         Connection* connection;
         std::ostringstream sql;
-        std::vector< v8::Persistent<v8::Value> > values;
+        std::vector<Value> values;
         bool async;
         bool cast;
         bool bufferText;
+        bool stream;
+        uint32_t batchSize;
+        uint32_t maxRows;
+        uint32_t maxResultBytes;
+        uint32_t highWaterMark;
+        uint32_t highWaterBytes;
+        uint32_t pauseTimeout;
+        bool paused;
+        execute_request_t* streaming;
+        bool columnar;
+        bool rowsAsArray;
+        bool lazy;
+        bool cursor;
+        bool collect;
+        bool prepare;
+        bool interpolated;
+        bool bigintAsNumber;
+        bool utc;
         v8::Persistent<v8::Function>* cbStart;
         v8::Persistent<v8::Function>* cbExecute;
         v8::Persistent<v8::Function>* cbFinish;
@@ -67,26 +172,90 @@ class Query : public EventEmitter {
         static v8::Handle<v8::Value> Delete(const v8::Arguments& args);
         static v8::Handle<v8::Value> Sql(const v8::Arguments& args);
         static v8::Handle<v8::Value> Execute(const v8::Arguments& args);
+        static v8::Handle<v8::Value> Pause(const v8::Arguments& args);
+        static v8::Handle<v8::Value> Resume(const v8::Arguments& args);
         static uv_async_t g_async;
         static void uvExecute(uv_work_t* uvRequest);
         static void uvExecuteFinished(uv_work_t* uvRequest, int status);
+        void executeFinished(execute_request_t* request);
+        static void uvExecuteStream(uv_async_t* uvAsync, int status);
+        static void uvStreamClosed(uv_handle_t* uvHandle);
         void executeAsync(execute_request_t* request);
+        static void fetchRows(execute_request_t* request) throw(Exception&);
+        static row_t* copyRow(execute_request_t* request, Arena* arena) throw(Exception&);
+        static void checkLimits(execute_request_t* request, const row_t* row) throw(Exception&);
+        static void prepareParsers(execute_request_t* request) throw(Exception&);
+        static void parseRow(execute_request_t* request, row_t* row);
+        static void pushBatch(execute_request_t* request, batch_t* batch) throw(Exception&);
+        static batch_t* popBatch(execute_request_t* request);
+        void streamBatches(execute_request_t* request);
+        v8::Local<v8::Array> emitRows(execute_request_t* request, const std::vector<row_t*>& rows, bool last);
+        v8::Local<v8::Array> emitResult(execute_request_t* request) throw(Exception&);
+        void prepareColumns(execute_request_t* request) const;
+        v8::Local<v8::Array> columns(execute_request_t* request) const;
+        v8::Local<v8::Object> columnarRows(execute_request_t* request, const std::vector<row_t*>& rows) const;
+        static void freeRows(std::vector<row_t*>* rows, Arena* arena);
         static void freeRequest(execute_request_t* request, bool freeAll = true);
         std::string fieldName(v8::Local<v8::Value> value) const throw(Exception&);
         std::string tableName(v8::Local<v8::Value> value, bool escape = true) const throw(Exception&);
         v8::Handle<v8::Value> addCondition(const v8::Arguments& args, const char* separator);
-        v8::Local<v8::Object> row(Result* result, row_t* currentRow) const;
+        v8::Local<v8::Object> row(execute_request_t* request, row_t* currentRow) const;
+        v8::Local<v8::Object> lazyRow(execute_request_t* request, row_t* currentRow, lazy_t* lazy, v8::Local<v8::Object> holder) const;
+        static v8::Handle<v8::Value> GetLazyColumn(v8::Local<v8::String> property, const v8::AccessorInfo& info);
+        static void SetLazyColumn(v8::Local<v8::String> property, v8::Local<v8::Value> value, const v8::AccessorInfo& info);
+        static void releaseLazyRows(v8::Persistent<v8::Value> holder, void* data);
+        cast_t caster(const Result::Column::info_t& column) const;
+        template<Result::Column::type_t T> static v8::Local<v8::Value> castValue(const char* value, unsigned long length, const cell_t* cell, Arena* arena);
+        static v8::Local<v8::Value> castBuffer(const char* value, unsigned long length, const cell_t* cell, Arena* arena);
+        static void releaseBuffer(char* data, void* hint);
+        static v8::Local<v8::Value> externalString(const char* value, unsigned long length, Arena* arena);
+        static bool isAscii(const char* value, unsigned long length);
+        static bool isShareable(unsigned long length, const Arena* arena);
+        static bool parseText(const char* value, unsigned long length, cell_t* cell, zones_t* zones);
+        static bool parseInteger(const char* value, unsigned long length, cell_t* cell, zones_t* zones);
+        static bool parseNumber(const char* value, unsigned long length, cell_t* cell, zones_t* zones);
+        static bool parseBigint(const char* value, unsigned long length, cell_t* cell, zones_t* zones);
+        static bool parseTime(const char* value, unsigned long length, cell_t* cell, zones_t* zones);
+        static bool parseDate(const char* value, unsigned long length, cell_t* cell, zones_t* zones);
+        static bool parseDatetime(const char* value, unsigned long length, cell_t* cell, zones_t* zones);
+        static bool parseUtcDate(const char* value, unsigned long length, cell_t* cell, zones_t* zones);
+        static bool parseUtcDatetime(const char* value, unsigned long length, cell_t* cell, zones_t* zones);
+        static bool parseTimestamp(const char* value, unsigned long length, bool hasTime, zones_t* zones, double* timestamp);
         virtual std::string parseQuery() const throw(Exception&);
+        std::string parseStatement() const throw(Exception&);
+        static Value toValue(v8::Local<v8::Value> value, bool escape = true, int precision = -1) throw(Exception&);
+        void bindValues(v8::Local<v8::Array> values) throw(Exception&);
         virtual std::vector<std::string::size_type> placeholders(std::string* parsed) const throw(Exception&);
         virtual Result* execute() const throw(Exception&);
         std::string value(v8::Local<v8::Value> value, bool inArray = false, bool escape = true, int precision = -1) const throw(Exception&);
+        void value(std::string* output, const Value& value, bool inArray = false) const throw(Exception&);
 
 
     private:
-        static bool gmtDeltaLoaded;
-        static int gmtDelta;
+        struct template_t {
+            std::string parsed;
+            std::vector<std::string::size_type> positions;
+        };
+        typedef std::tr1::shared_ptr<const template_t> template_ptr_t;
+        typedef std::list< std::pair<char, const std::string*> > templates_usage_t;
+        struct cached_template_t {
+            template_ptr_t value;
+            templates_usage_t::iterator usage;
+        };
+        typedef std::map<std::string, cached_template_t> templates_t;
+        static pthread_mutex_t zonesLock;
+        static zones_t zones;
+        static pthread_mutex_t templatesLock;
+        static std::map<char, templates_t> templates;
+        static templates_usage_t templatesUsage;
+
+        static int64_t daysFromCivil(int year, int month, int day);
+        static int localOffset(int64_t timestamp);
+        static int zoneOffset(zones_t* zones, int year, int64_t timestamp);
+        static std::vector<zone_t> zoneTransitions(int year);
 
-        std::string fromDate(const double timeStamp) const throw(Exception&);
+        template_ptr_t parseTemplate() const throw(Exception&);
+        void fromDate(std::string* output, const double timeStamp) const throw(Exception&);
 };
 }
 
@@ -1,5 +1,6 @@
 // Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
 #include "./result.h"
+#include "./statement.h"
 
 node_db::Result::Column::~Column() {
 }
@@ -8,6 +9,17 @@ bool node_db::Result::Column::isBinary() const {
     return false;
 }
 
+std::vector<node_db::Result::Column::info_t> node_db::Result::columns() const throw(std::out_of_range&) {
+    std::vector<Column::info_t> columns(this->columnCount());
+    for (uint16_t i = 0, limiti = columns.size(); i < limiti; i++) {
+        Column* column = this->column(i);
+        columns[i].name = column->getName();
+        columns[i].type = column->getType();
+        columns[i].binary = column->isBinary();
+    }
+    return columns;
+}
+
 uint64_t node_db::Result::count() const throw(Exception&) {
     throw node_db::Exception("Not implemented");
 }
@@ -20,7 +32,16 @@ uint16_t node_db::Result::warningCount() const throw(node_db::Exception&){
     throw node_db::Exception("Not implemented");
 }
 
+node_db::Result::Result()
+    :statement(NULL) {
+}
+
 node_db::Result::~Result() {
+    // Runs after the driver's destructor, so the result is gone by the time
+    // the statement that produced it can be deleted
+    if (this->statement != NULL) {
+        this->statement->release();
+    }
 }
 
 void node_db::Result::release() throw() {
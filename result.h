@@ -5,9 +5,12 @@
 #include <stdint.h>
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include "./exception.h"
 
 namespace node_db {
+class Statement;
+
 class Result {
     public:
         class Column {
@@ -24,6 +27,11 @@ class Result {
                     BOOL,
                     SET
                 } type_t;
+                struct info_t {
+                    std::string name;
+                    type_t type;
+                    bool binary;
+                };
 
                 virtual ~Column();
                 virtual std::string getName() const = 0;
@@ -31,6 +39,7 @@ class Result {
                 virtual bool isBinary() const;
         };
 
+        Result();
         virtual ~Result();
         virtual void release() throw();
         virtual bool hasNext() const throw(Exception&) = 0;
@@ -38,6 +47,7 @@ class Result {
         virtual unsigned long* columnLengths() throw(Exception&) = 0;
         virtual uint64_t index() const throw(std::out_of_range&) = 0;
         virtual Column* column(uint16_t i) const throw(std::out_of_range&) = 0;
+        virtual std::vector<Column::info_t> columns() const throw(std::out_of_range&);
         virtual uint64_t insertId() const throw(Exception&);
         virtual uint64_t affectedCount() const throw() = 0;
         virtual uint16_t warningCount() const throw(Exception&);
@@ -45,6 +55,11 @@ class Result {
         virtual uint64_t count() const throw(Exception&);
         virtual bool isBuffered() const throw() = 0;
         virtual bool isEmpty() const throw() = 0;
+
+    protected:
+        Statement* statement;
+
+        friend class Statement;
 };
 }
 
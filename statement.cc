@@ -0,0 +1,59 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./statement.h"
+#include "./connection.h"
+
+node_db::Statement::Statement()
+    :connection(NULL),
+    references(1) {
+    pthread_mutex_init(&(this->referencesLock), NULL);
+}
+
+node_db::Statement::~Statement() {
+    pthread_mutex_destroy(&(this->referencesLock));
+}
+
+node_db::Result* node_db::Statement::execute(const std::vector<Value>& parameters) throw(Exception&) {
+    node_db::Result* result = this->query(parameters);
+
+    // The result keeps the statement alive, and busy, until it is deleted
+    if (result != NULL) {
+        this->retain();
+        result->statement = this;
+    }
+
+    return result;
+}
+
+bool node_db::Statement::isBusy() throw() {
+    // Besides the reference held by its owner, any other is a live result
+    pthread_mutex_lock(&(this->referencesLock));
+    bool busy = (this->references > 1);
+    pthread_mutex_unlock(&(this->referencesLock));
+    return busy;
+}
+
+void node_db::Statement::retain() throw() {
+    pthread_mutex_lock(&(this->referencesLock));
+    this->references++;
+    pthread_mutex_unlock(&(this->referencesLock));
+}
+
+void node_db::Statement::release() throw() {
+    // Results are deleted on the main thread, while the connection evicts
+    // statements from the thread executing queries
+    pthread_mutex_lock(&(this->referencesLock));
+    bool unused = (--this->references == 0);
+    pthread_mutex_unlock(&(this->referencesLock));
+
+    if (!unused) {
+        return;
+    }
+
+    // Tearing down a statement talks to the server, so cached ones are left
+    // to their connection to destroy while it is locked
+    if (this->connection != NULL) {
+        this->connection->releaseStatement(this);
+    } else {
+        delete this;
+    }
+}
@@ -0,0 +1,34 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef STATEMENT_H_
+#define STATEMENT_H_
+
+#include <pthread.h>
+#include <vector>
+#include "./exception.h"
+#include "./result.h"
+#include "./value.h"
+
+namespace node_db {
+class Connection;
+
+class Statement {
+    public:
+        Statement();
+        Result* execute(const std::vector<Value>& parameters) throw(Exception&);
+        bool isBusy() throw();
+        void retain() throw();
+        void release() throw();
+
+    protected:
+        Connection* connection;
+        pthread_mutex_t referencesLock;
+        unsigned int references;
+
+        virtual ~Statement();
+        virtual Result* query(const std::vector<Value>& parameters) throw(Exception&) = 0;
+
+        friend class Connection;
+};
+}
+
+#endif  // STATEMENT_H_
@@ -67,6 +67,382 @@ exports.get = function(createDbClient, quoteName) {
                     });
                 });
             });
+        },
+        "streamed results": function(test) {
+            var client = this.client, each = 0, batches = [];
+            test.expect(6);
+
+            var query = client.query("SELECT 1 AS n UNION ALL SELECT 2 UNION ALL SELECT 3", { stream: true, batchSize: 2 });
+            query.on("each", function(row, index, last) {
+                each++;
+            });
+            query.on("batch", function(rows, last) {
+                batches.push([ rows.length, last ]);
+            });
+            query.execute(function(error, rows, columns) {
+                test.equal(null, error);
+                test.equal(3, each);
+                test.equal(2, batches.length);
+                test.deepEqual([ 2, false ], batches[0]);
+                test.deepEqual([ 1, true ], batches[1]);
+                test.equal(null, rows);
+                test.done();
+            });
+        },
+        "batch events": function(test) {
+            var client = this.client, batches = [];
+            test.expect(4);
+
+            var query = client.query("SELECT 1 AS n UNION ALL SELECT 2 UNION ALL SELECT 3", { batchSize: 2 });
+            query.on("batch", function(rows, last) {
+                batches.push([ rows.length, last ]);
+            });
+            query.execute(function(error, rows) {
+                test.equal(null, error);
+                test.equal(3, rows.length);
+                test.deepEqual([ 2, false ], batches[0]);
+                test.deepEqual([ 1, true ], batches[1]);
+                test.done();
+            });
+        },
+        "uncollected rows": function(test) {
+            var client = this.client, each = 0;
+            test.expect(3);
+
+            var query = client.query("SELECT 1 AS n UNION ALL SELECT 2 UNION ALL SELECT 3", { collect: false });
+            query.on("each", function(row, index, last) {
+                each++;
+            });
+            query.execute(function(error, rows) {
+                test.equal(null, error);
+                test.equal(null, rows);
+                test.equal(3, each);
+                test.done();
+            });
+        },
+        "paused stream": function(test) {
+            var client = this.client, batches = 0, resumed = false;
+            test.expect(4);
+
+            var query = client.query("SELECT 1 AS n UNION ALL SELECT 2 UNION ALL SELECT 3", { stream: true, batchSize: 1, highWaterMark: 1 });
+            query.on("batch", function(rows, last) {
+                if (batches++ === 0) {
+                    query.pause();
+                    setTimeout(function() {
+                        resumed = true;
+                        query.resume();
+                    }, 50);
+                }
+            });
+            query.execute(function(error, rows) {
+                test.equal(null, error);
+                test.ok(resumed);
+                test.equal(3, batches);
+                test.equal(null, rows);
+                test.done();
+            });
+        },
+        "query during paused stream": function(test) {
+            var client = this.client, batches = 0;
+            test.expect(3);
+
+            var query = client.query("SELECT 1 AS n UNION ALL SELECT 2 UNION ALL SELECT 3", { stream: true, batchSize: 1, highWaterMark: 1 });
+            query.on("batch", function(rows, last) {
+                if (batches++ === 0) {
+                    query.pause();
+                    // An unbuffered stream keeps the connection until it is read
+                    client.query("SELECT 1 AS n").execute(function(error, rows) {
+                        test.ok(error === null || /another result is being read/.test(error));
+                        query.resume();
+                    });
+                }
+            });
+            query.execute(function(error, rows) {
+                test.equal(null, error);
+                test.equal(3, batches);
+                test.done();
+            });
+        },
+        "resumed from handler": function(test) {
+            var client = this.client, batches = 0, finished = 0;
+            test.expect(3);
+
+            var query = client.query("SELECT 1 AS n UNION ALL SELECT 2 UNION ALL SELECT 3", { stream: true, batchSize: 1, highWaterBytes: 1 });
+            query.on("batch", function(rows, last) {
+                batches++;
+                query.pause();
+                query.resume();
+            });
+            query.execute(function(error, rows) {
+                finished++;
+                test.equal(null, error);
+                test.equal(3, batches);
+                setTimeout(function() {
+                    test.equal(1, finished);
+                    test.done();
+                }, 50);
+            });
+        },
+        "columnar results": function(test) {
+            var client = this.client;
+            test.expect(6);
+
+            client.query("SELECT 1 AS n, 'a' AS s UNION ALL SELECT 2, 'b'", { layout: "columnar" }).execute(function(error, rows, columns) {
+                test.equal(null, error);
+                test.equal(2, columns.length);
+                test.equal(2, rows.n.length);
+                test.equal(1, rows.n[0]);
+                test.equal(2, rows.n[1]);
+                test.deepEqual([ "a", "b" ], rows.s);
+                test.done();
+            });
+        },
+        "array rows": function(test) {
+            var client = this.client;
+            test.expect(5);
+
+            client.query("SELECT 1 AS n, 'a' AS s", { rowsAs: "array" }).execute(function(error, rows, columns) {
+                test.equal(null, error);
+                test.equal(1, rows.length);
+                test.ok(Array.isArray(rows[0]));
+                test.equal(1, rows[0][0]);
+                test.equal("a", rows[0][1]);
+                test.done();
+            });
+        },
+        "numeric casting": function(test) {
+            var client = this.client;
+            var values = [
+                "0", "-1", "7", "2147483647", "-2147483648", "2147483648", "-2147483649",
+                "4294967296", "9007199254740991", "-9007199254740991",
+                "0.5", "-0.25", "1.1", "3.14159265358979", "123456789.123456789",
+                "0.000001", "1e21", "-1.5e-7", "2.2250738585072014e-308", "1.7976931348623157e308"
+            ];
+            test.expect(2 + values.length);
+
+            var sql = "SELECT " + values.map(function(value, index) {
+                return value + " AS " + quoteName + "v" + index + quoteName;
+            }).join(", ");
+
+            client.query(sql, { cast: false, rowsAs: "array" }).execute(function(error, raw) {
+                test.equal(null, error);
+                client.query(sql, { rowsAs: "array" }).execute(function(error, cast) {
+                    test.equal(null, error);
+                    for (var i = 0; i < values.length; i++) {
+                        test.strictEqual(Number(raw[0][i]), cast[0][i], "value " + values[i]);
+                    }
+                    test.done();
+                });
+            });
+        },
+        "bigint casting": function(test) {
+            var client = this.client;
+            test.expect(6);
+
+            var sql = "SELECT CAST(42 AS SIGNED) AS small, CAST(9007199254740993 AS SIGNED) AS large";
+            client.query(sql).execute(function(error, rows) {
+                test.equal(null, error);
+                test.strictEqual(42, rows[0].small);
+                test.strictEqual("9007199254740993", rows[0].large);
+                client.query(sql, { bigint: "number" }).execute(function(error, rows) {
+                    test.equal(null, error);
+                    test.strictEqual(42, rows[0].small);
+                    test.strictEqual(9007199254740992, rows[0].large);
+                    test.done();
+                });
+            });
+        },
+        "date casting": function(test) {
+            var client = this.client;
+            test.expect(6);
+
+            var sql = "SELECT CAST('2011-03-02' AS DATE) AS d, CAST('2011-07-09 10:20:30' AS DATETIME) AS dt";
+            client.query(sql).execute(function(error, rows) {
+                test.equal(null, error);
+                test.equal(new Date(2011, 2, 2).getTime(), rows[0].d.getTime());
+                test.equal(new Date(2011, 6, 9, 10, 20, 30).getTime(), rows[0].dt.getTime());
+                client.query(sql, { timezone: "utc" }).execute(function(error, rows) {
+                    test.equal(null, error);
+                    test.equal(Date.UTC(2011, 2, 2), rows[0].d.getTime());
+                    test.equal(Date.UTC(2011, 6, 9, 10, 20, 30), rows[0].dt.getTime());
+                    test.done();
+                });
+            });
+        },
+        "date round trip": function(test) {
+            var client = this.client;
+            test.expect(4);
+
+            var date = new Date(2011, 6, 9, 10, 20, 30);
+            client.query("SELECT CAST(? AS DATETIME) AS dt", [ date ]).execute(function(error, rows) {
+                test.equal(null, error);
+                test.equal(date.getTime(), rows[0].dt.getTime());
+                client.query("SELECT CAST(? AS DATETIME) AS dt", [ date ], { timezone: "utc" }).execute(function(error, rows) {
+                    test.equal(null, error);
+                    test.equal(date.getTime(), rows[0].dt.getTime());
+                    test.done();
+                });
+            });
+        },
+        "binary columns": function(test) {
+            var client = this.client;
+            test.expect(5);
+
+            client.query("SELECT UNHEX('00FF80') AS b").execute(function(error, rows) {
+                test.equal(null, error);
+                test.ok(Buffer.isBuffer(rows[0].b));
+                test.equal(3, rows[0].b.length);
+                test.equal(255, rows[0].b[1]);
+                test.equal(128, rows[0].b[2]);
+                test.done();
+            });
+        },
+        "large text values": function(test) {
+            var client = this.client;
+            test.expect(5);
+
+            var ascii = new Array(5001).join("a"), utf8 = new Array(2001).join("\u00e9");
+            client.query("SELECT REPEAT('a', 5000) AS ascii, REPEAT(_utf8'\u00e9', 2000) AS utf8").execute(function(error, rows) {
+                test.equal(null, error);
+                test.equal(5000, rows[0].ascii.length);
+                test.equal(ascii, rows[0].ascii);
+                test.equal(2000, rows[0].utf8.length);
+                test.equal(utf8, rows[0].utf8);
+                test.done();
+            });
+        },
+        "lazy rows": function(test) {
+            var client = this.client;
+            test.expect(7);
+
+            client.query("SELECT 1 AS a, 'x' AS b, NULL AS c UNION ALL SELECT 2, 'y', NULL", { lazy: true }).execute(function(error, rows) {
+                test.equal(null, error);
+                test.equal(2, rows.length);
+                test.strictEqual(1, rows[0].a);
+                test.strictEqual("y", rows[1].b);
+                test.strictEqual(null, rows[1].c);
+                test.deepEqual([ "a", "b", "c" ], Object.keys(rows[0]));
+                rows[0].a = 5;
+                test.strictEqual(5, rows[0].a);
+                test.done();
+            });
+        },
+        "set columns": function(test) {
+            var client = this.client;
+            test.expect(4);
+
+            client.query("CREATE TEMPORARY TABLE set_columns (s SET('read','write','admin'))").execute(function(error) {
+                test.equal(null, error);
+                client.query("INSERT INTO set_columns VALUES ('read,admin'), ('')").execute(function(error) {
+                    test.equal(null, error);
+                    client.query("SELECT s FROM set_columns").execute(function(error, rows) {
+                        test.deepEqual([ "read", "admin" ], rows[0].s);
+                        test.deepEqual([], rows[1].s);
+                        client.query("DROP TEMPORARY TABLE set_columns").execute();
+                        test.done();
+                    });
+                });
+            });
+        },
+        "cursor": function(test) {
+            var client = this.client;
+            test.expect(11);
+
+            var sql = "SELECT 1 AS n UNION ALL SELECT 2 UNION ALL SELECT 3 UNION ALL SELECT 4 UNION ALL SELECT 5";
+            client.query(sql, { cursor: true }).execute(function(error, cursor, columns) {
+                test.equal(null, error);
+                test.equal(1, columns.length);
+                cursor.fetch(2, function(error, rows, done) {
+                    test.equal(null, error);
+                    test.deepEqual([ 1, 2 ], rows.map(function(row) { return row.n; }));
+                    test.equal(false, done);
+                    cursor.fetch(4, function(error, rows, done) {
+                        test.equal(null, error);
+                        test.deepEqual([ 3, 4, 5 ], rows.map(function(row) { return row.n; }));
+                        test.equal(true, done);
+                        cursor.fetch(1, function(error, rows, done) {
+                            test.equal(0, rows.length);
+                            test.equal(true, done);
+                            cursor.close();
+                            test.throws(function() {
+                                cursor.fetch(1, function() {});
+                            });
+                            test.done();
+                        });
+                    });
+                });
+            });
+        },
+        "closed cursor": function(test) {
+            var client = this.client;
+            test.expect(4);
+
+            var sql = "SELECT 1 AS n UNION ALL SELECT 2 UNION ALL SELECT 3";
+            client.query(sql, { cursor: true }).execute(function(error, cursor) {
+                test.equal(null, error);
+                cursor.fetch(1, function(error, rows, done) {
+                    test.equal(null, error);
+                    cursor.close();
+                    client.query(sql).execute(function(error, rows) {
+                        test.equal(null, error);
+                        test.equal(3, rows.length);
+                        test.done();
+                    });
+                });
+            });
+        },
+        "sync result limits": function(test) {
+            var client = this.client;
+            test.expect(3);
+
+            var sql = "SELECT 'abc' AS s UNION ALL SELECT 'def' UNION ALL SELECT 'ghi'";
+            client.query(sql, { async: false, maxRows: 2 }).execute(function(error, rows) {
+                test.ok(/maximum of 2 rows/.test(error));
+                client.query(sql, { async: false }).execute(function(error, rows) {
+                    test.equal(null, error);
+                    test.equal(3, rows.length);
+                    test.done();
+                });
+            });
+        },
+        "uncollected cursor": function(test) {
+            var client = this.client;
+            test.expect(5);
+
+            var sql = "SELECT 1 AS n UNION ALL SELECT 2 UNION ALL SELECT 3", fetched = 0;
+            var query = client.query(sql, { cursor: true, collect: false });
+            query.on("each", function(row) {
+                fetched++;
+            });
+            query.execute(function(error, cursor) {
+                test.equal(null, error);
+                test.ok(cursor !== null);
+                cursor.fetch(3, function(error, rows, done) {
+                    test.equal(null, error);
+                    test.equal(3, fetched);
+                    cursor.close();
+                    client.query(sql).execute(function(error, rows) {
+                        test.equal(3, rows.length);
+                        test.done();
+                    });
+                });
+            });
+        },
+        "result limits": function(test) {
+            var client = this.client;
+            test.expect(3);
+
+            var sql = "SELECT 'abc' AS s UNION ALL SELECT 'def' UNION ALL SELECT 'ghi'";
+            client.query(sql, { maxRows: 2 }).execute(function(error, rows) {
+                test.ok(/maximum of 2 rows/.test(error));
+                client.query(sql, { maxResultBytes: 5 }).execute(function(error, rows) {
+                    test.ok(/maximum of 5 bytes/.test(error));
+                    client.query(sql, { maxRows: 3 }).execute(function(error, rows) {
+                        test.equal(3, rows.length);
+                        test.done();
+                    });
+                });
+            });
         }
     });
 
@@ -218,6 +594,148 @@ exports.get = function(createDbClient, quoteName) {
 
             test.done();
         },
+        "many markers": function(test) {
+            var client = this.client;
+            test.expect(1);
+
+            var markers = [], values = [];
+            for (var i = 0; i < 5000; i++) {
+                markers.push("?");
+                values.push(i);
+            }
+
+            client.query(
+                "SELECT * FROM users WHERE name <> '?' AND id IN (" + markers.join(",") + ") AND name <> \\?",
+                values,
+                { start: function (query) {
+                    test.equal("SELECT * FROM users WHERE name <> '?' AND id IN (" + values.join(",") + ") AND name <> ?", query);
+                    return false;
+                }}
+            ).execute();
+
+            test.done();
+        },
+        "repeated markers": function(test) {
+            var client = this.client;
+            test.expect(3);
+
+            var sql = "SELECT *, 'Use ? mark', Unquoted\\?mark FROM users WHERE id = ?";
+            [ 1, 2, "three" ].forEach(function(id) {
+                client.query(
+                    sql,
+                    [ id ],
+                    { start: function (query) {
+                        test.equal("SELECT *, 'Use ? mark', Unquoted?mark FROM users WHERE id = " + (typeof(id) === "string" ? "'" + id + "'" : id), query);
+                        return false;
+                    }}
+                ).execute();
+            });
+
+            test.done();
+        },
+        "prepared markers": function(test) {
+            var client = this.client;
+            test.expect(6);
+
+            client.query(
+                "SELECT *, 'Use ? mark' FROM users WHERE id = ? AND name = ?",
+                [ 2, "Jane O'Hara" ],
+                { prepare: true, start: function (query) {
+                    test.equal("SELECT *, 'Use ? mark' FROM users WHERE id = ? AND name = ?", query);
+                    return false;
+                }}
+            ).execute();
+
+            test.throws(
+                function () {
+                    client.query("SELECT * FROM users WHERE id IN ?", [ [1, 2] ], { prepare: true }).execute();
+                },
+                "Arrays, subqueries, unescaped values and numbers with a precision can't be bound as statement parameters"
+            );
+
+            test.throws(
+                function () {
+                    client.query("SELECT * FROM users WHERE age > ?", [ { value: 1.5, precision: 2 } ], { prepare: true }).execute();
+                },
+                "Arrays, subqueries, unescaped values and numbers with a precision can't be bound as statement parameters"
+            );
+
+            test.throws(
+                function () {
+                    client.query().insert("users", ["name"], ["Jane O'Hara"]).execute({ prepare: true });
+                },
+                "Values given to select(), insert() or set() can't be used in prepared statements, bind them with ? markers instead"
+            );
+
+            test.throws(
+                function () {
+                    client.query().select({ "greeting": "'hello'" }).from("users").execute({ prepare: true });
+                },
+                "Values given to select(), insert() or set() can't be used in prepared statements, bind them with ? markers instead"
+            );
+
+            test.throws(
+                function () {
+                    client.query().update("users").set({ "name": "Jane O'Hara" }).where("id = ?", [ 2 ]).execute({ prepare: true });
+                },
+                "Values given to select(), insert() or set() can't be used in prepared statements, bind them with ? markers instead"
+            );
+
+            test.done();
+        },
+        "prepared statement": function(test) {
+            var client = this.client;
+
+            // Executed twice, so the second run goes through the cached statement
+            var sql = "SELECT ? AS id, ? AS name";
+            client.query(sql, [ 2, "Jane O'Hara" ], { prepare: true }).execute(function(error, rows) {
+                if (error === "Not implemented") {
+                    // Drivers without prepared statements report it on execute
+                    test.expect(1);
+                    test.equal("Not implemented", error);
+                    test.done();
+                    return;
+                }
+
+                test.expect(6);
+                test.equal(null, error);
+                test.equal(2, rows[0].id);
+                test.equal("Jane O'Hara", rows[0].name);
+                client.query(sql, [ 3, "John Doe" ], { prepare: true }).execute(function(error, rows) {
+                    test.equal(null, error);
+                    test.equal(3, rows[0].id);
+                    test.equal("John Doe", rows[0].name);
+                    test.done();
+                });
+            });
+        },
+        "bound values": function(test) {
+            var client = this.client;
+            test.expect(2);
+
+            var ids = [ 1, 2 ], values = [ ids, "Jane" ];
+            var query = client.query(
+                "SELECT * FROM users WHERE id IN ? AND name = ?",
+                values,
+                { start: function (query) {
+                    test.equal("SELECT * FROM users WHERE id IN (1,2) AND name = 'Jane'", query);
+                    return false;
+                }}
+            );
+
+            ids.push(3);
+            values[1] = "John";
+            query.execute();
+
+            test.throws(
+                function () {
+                    client.query().select("*").from("users").where("id = ?", [ undefined ]);
+                },
+                "Unknown type for to convert to SQL, converting `undefined'"
+            );
+
+            test.done();
+        },
         "insert markers": function(test) {
             var client = this.client;
             test.expect(6);
@@ -0,0 +1,122 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./value.h"
+
+node_db::Value::Value()
+    :type(NONE),
+    integer(0),
+    list(NULL) {
+}
+
+node_db::Value::Value(const Value& other)
+    :type(other.type),
+    integer(other.integer),
+    string(other.string),
+    list(other.list != NULL ? new std::vector<Value>(*(other.list)) : NULL) {
+}
+
+node_db::Value::~Value() {
+    delete this->list;
+}
+
+node_db::Value& node_db::Value::operator=(const Value& other) {
+    if (this != &other) {
+        std::vector<Value>* list = (other.list != NULL ? new std::vector<Value>(*(other.list)) : NULL);
+        delete this->list;
+        this->list = list;
+        this->type = other.type;
+        this->integer = other.integer;
+        this->string = other.string;
+    }
+    return *this;
+}
+
+node_db::Value::type_t node_db::Value::getType() const {
+    return this->type;
+}
+
+bool node_db::Value::isNull() const {
+    return (this->type == NONE);
+}
+
+bool node_db::Value::getBool() const {
+    return this->boolean;
+}
+
+int64_t node_db::Value::getInt() const {
+    return this->integer;
+}
+
+double node_db::Value::getNumber() const {
+    return this->number;
+}
+
+double node_db::Value::getDate() const {
+    return this->number;
+}
+
+const std::string& node_db::Value::getString() const {
+    return this->string;
+}
+
+const std::vector<node_db::Value>& node_db::Value::getList() const {
+    // Only valid for LIST values
+    return *(this->list);
+}
+
+std::vector<node_db::Value>& node_db::Value::getList() {
+    return *(this->list);
+}
+
+void node_db::Value::setNull() {
+    this->type = NONE;
+    this->string.clear();
+    delete this->list;
+    this->list = NULL;
+}
+
+void node_db::Value::setBool(bool value) {
+    this->type = BOOL;
+    this->boolean = value;
+}
+
+void node_db::Value::setInt(int64_t value) {
+    this->type = INT;
+    this->integer = value;
+}
+
+void node_db::Value::setNumber(double value, const char* text, size_t length) {
+    // The text, when given, is how the number is written into SQL
+    this->type = NUMBER;
+    this->number = value;
+    if (text != NULL) {
+        this->string.assign(text, length);
+    } else {
+        this->string.clear();
+    }
+}
+
+void node_db::Value::setDate(double timeStamp) {
+    // Dates are kept as milliseconds since the epoch, as V8 does
+    this->type = DATE;
+    this->number = timeStamp;
+}
+
+void node_db::Value::setString(const char* value, size_t length) {
+    this->type = STRING;
+    this->string.assign(value, length);
+}
+
+void node_db::Value::setRaw(const char* value, size_t length) {
+    // Raw values are SQL fragments, written as they are
+    this->type = RAW;
+    this->string.assign(value, length);
+}
+
+void node_db::Value::setList() {
+    this->type = LIST;
+    if (this->list == NULL) {
+        this->list = new std::vector<Value>();
+    } else {
+        this->list->clear();
+    }
+}
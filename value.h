@@ -0,0 +1,58 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef VALUE_H_
+#define VALUE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace node_db {
+class Value {
+    public:
+        typedef enum {
+            NONE,
+            BOOL,
+            INT,
+            NUMBER,
+            DATE,
+            STRING,
+            RAW,
+            LIST
+        } type_t;
+
+        Value();
+        Value(const Value& other);
+        ~Value();
+        Value& operator=(const Value& other);
+        type_t getType() const;
+        bool isNull() const;
+        bool getBool() const;
+        int64_t getInt() const;
+        double getNumber() const;
+        double getDate() const;
+        const std::string& getString() const;
+        const std::vector<Value>& getList() const;
+        std::vector<Value>& getList();
+        void setNull();
+        void setBool(bool value);
+        void setInt(int64_t value);
+        void setNumber(double value, const char* text = NULL, size_t length = 0);
+        void setDate(double timeStamp);
+        void setString(const char* value, size_t length);
+        void setRaw(const char* value, size_t length);
+        void setList();
+
+    protected:
+        type_t type;
+        union {
+            bool boolean;
+            int64_t integer;
+            double number;
+        };
+        std::string string;
+        // Held out of line, as Value is still incomplete at this point
+        std::vector<Value>* list;
+};
+}
+
+#endif  // VALUE_H_